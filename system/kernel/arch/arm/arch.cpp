@@ -9,6 +9,8 @@
 #include <feline/logger.h>
 #include <feline/settings.h>
 #include <kernel/arch.h>
+#include <kernel/cpu.h>
+#include <kernel/percpu.h>
 #include <kernel/devicetree.h>
 #include <kernel/halt.h>
 #include <kernel/interrupts.h>
@@ -35,6 +37,9 @@ Also note that the interrupts actually log stuff, so watch out!
 After this we should be good to go! */
 int early_boot_setup(uintptr_t devicetree_header_addr) {
 	PhysAddr<fdt_header const> devicetree(devicetree_header_addr);
+	/* It isn't reset to anything, and per-CPU variables are used before
+	 * init_percpu */
+	arch_set_percpu_offset(0, 0);
 	idt_init(); /* Actually display an error if we have a problem: don't just
 	               triple fault */
 	if (setup_paging() != 0) {
@@ -71,3 +76,12 @@ int boot_setup() {
 		nullptr);
 	return 0;
 }
+
+void arch_set_percpu_offset(unsigned, uintptr_t offset) {
+	__asm__ volatile("mcr p15, 0, %0, c13, c0, 4" : : "r"(offset) : "memory");
+}
+
+/* TODO: start the other cores. Until then there's only ever this one. */
+void start_other_cpus() {}
+
+void kick_cpu(unsigned) {}
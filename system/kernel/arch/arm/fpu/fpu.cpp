@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#include <cstdint>
+#include <kernel/asm_compat.h>
+#include <kernel/fpu.h>
+
+/* Full access to coprocessors 10 and 11 (the VFP) */
+#define CPACR_VFP_ACCESS (0xF << 20)
+#define FPEXC_EN (1 << 30)
+
+/* What a task that hasn't used the VFP starts with: zeroed registers, round to
+ * nearest and no exceptions trapped */
+static FpuState const initial_state{};
+
+/* The kernel is built for soft float, so tell the assembler the VFP is there */
+static uint32_t read_fpexc() {
+	uint32_t fpexc;
+	__asm__ volatile(".fpu vfp\n\tvmrs %0, fpexc" : "=r"(fpexc));
+	return fpexc;
+}
+static void write_fpexc(uint32_t fpexc) {
+	__asm__ volatile(".fpu vfp\n\tvmsr fpexc, %0" : : "r"(fpexc) : "memory");
+}
+
+void arch_init_fpu() {
+	uint32_t cpacr;
+	__asm__ volatile("mrc p15, 0, %0, c1, c0, 2" : "=r"(cpacr));
+	cpacr |= CPACR_VFP_ACCESS;
+	__asm__ volatile("mcr p15, 0, %0, c1, c0, 2" : : "r"(cpacr));
+	/* Flush the prefetch buffer, so nothing after runs with the old access */
+	__asm__ volatile("mcr p15, 0, %0, c7, c5, 4" : : "r"(0) : "memory");
+	arch_disable_fpu();
+}
+
+void arch_enable_fpu() { write_fpexc(FPEXC_EN); }
+
+void arch_disable_fpu() { write_fpexc(0); }
+
+void arch_reset_fpu() { arch_restore_fpu(&initial_state); }
+
+void arch_save_fpu(FpuState *state) {
+	uint32_t fpscr;
+	__asm__ volatile(".fpu vfp\n\t"
+	                 "vstmia %1, {d0-d15}\n\t"
+	                 "vmrs %0, fpscr"
+	                 : "=r"(fpscr)
+	                 : "r"(state->d)
+	                 : "memory");
+	state->fpscr = fpscr;
+}
+
+void arch_restore_fpu(FpuState const *state) {
+	__asm__ volatile(".fpu vfp\n\t"
+	                 "vldmia %0, {d0-d15}\n\t"
+	                 "vmsr fpscr, %1"
+	                 :
+	                 : "r"(state->d), "r"(state->fpscr)
+	                 : "memory");
+}
+
+/* Called by undef_handler with the instruction that was undefined. Returns
+ * true if it was for the disabled VFP, which is now enabled, so it should be
+ * run again. */
+ASM bool handle_undefined_instruction(uint32_t instruction) {
+	/* LDC/STC, MCRR/MRRC, CDP and MCR/MRC all encode the coprocessor in bits
+	 * 8-11 */
+	bool coprocessor = (instruction & 0x0E00'0000) == 0x0C00'0000 ||
+	                   (instruction & 0x0F00'0000) == 0x0E00'0000;
+	uint32_t cp_num = (instruction >> 8) & 0xF;
+	if (!coprocessor || (cp_num != 10 && cp_num != 11)) {
+		return false;
+	}
+	/* If it's enabled, the VFP really didn't like the instruction */
+	if ((read_fpexc() & FPEXC_EN) != 0) {
+		return false;
+	}
+	fpu_trap();
+	return true;
+}
@@ -1,25 +1,76 @@
 #include <cstdint>
+#include <cstdlib>
+#include <feline/logger.h>
 #include <kernel/asm_compat.h>
 #include <kernel/interrupts.h>
+#include <kernel/irq.h>
 #include <kernel/paging.h>
 #include <kernel/phys_addr.h>
 #include <stdint.h>
 
-uint32_t *IRQ_basic_pending;
+typedef uint32_t volatile irq_reg;
+
+/* The BCM2835's interrupt controller */
+struct InterruptController {
+		irq_reg basic_pending;
+		irq_reg pending_1;
+		irq_reg pending_2;
+		irq_reg fiq_control;
+		irq_reg enable_1;
+		irq_reg enable_2;
+		irq_reg enable_basic;
+		irq_reg disable_1;
+		irq_reg disable_2;
+		irq_reg disable_basic;
+};
+
+/* The ARM IRQs are the low byte of basic_pending */
+#define BASIC_ARM_IRQS 0xFF
+/* The rest of basic_pending says there are GPU IRQs in the pending registers
+ * (or are copies of some of them) */
+#define BASIC_GPU_IRQS 0x1FFF00
+/* Where the ARM IRQs are numbered from */
+#define FIRST_ARM_IRQ 64
+
+static InterruptController *controller = nullptr;
 
 ASM void setup_irqs() {
-	PhysAddr<uint32_t> basic_pending_addr(0x2000'B000);
-	map_range(PhysAddr<uint32_t>(0x2000'B200), sizeof(uint32_t),
-	          reinterpret_cast<void **>(&IRQ_basic_pending), MAP_DEVICE);
+	PhysAddr<InterruptController> controller_addr(0x2000'B200);
+	auto result = map_range(controller_addr, sizeof(InterruptController),
+	                        reinterpret_cast<void **>(&controller), MAP_DEVICE);
+	if (result != map_success) {
+		kCritical() << "Unable to map the interrupt controller!";
+		std::abort();
+	}
+}
+
+void arch_enable_irq(unsigned line) {
+	if (line < 32) {
+		controller->enable_1 = 1u << line;
+	} else if (line < FIRST_ARM_IRQ) {
+		controller->enable_2 = 1u << (line - 32);
+	} else {
+		controller->enable_basic = 1u << (line - FIRST_ARM_IRQ);
+	}
+}
+
+void arch_disable_irq(unsigned line) {
+	if (line < 32) {
+		controller->disable_1 = 1u << line;
+	} else if (line < FIRST_ARM_IRQ) {
+		controller->disable_2 = 1u << (line - 32);
+	} else {
+		controller->disable_basic = 1u << (line - FIRST_ARM_IRQ);
+	}
 }
 
 ASM void interrupt_handler() {
-	// Check interrupt status bits, most to least important.
-	// Change priority by reordering the checks, or by making one a FIQ.
-	uint32_t IRQ_status = *IRQ_basic_pending;
-	if (IRQ_status & (1 << 8)) {
-		return systimer_irq_handler();
+	uint32_t basic = controller->basic_pending;
+	/* Only enabled IRQs show up as pending, so these are all ours */
+	if ((basic & BASIC_GPU_IRQS) != 0) {
+		dispatch_irqs(controller->pending_1, 0);
+		dispatch_irqs(controller->pending_2, 32);
 	}
-	kCriticalNoAlloc() << "Unknown interrupt " << hex(*IRQ_basic_pending);
-	return;
+	dispatch_irqs(basic & BASIC_ARM_IRQS, FIRST_ARM_IRQ);
+	irq_exit();
 }
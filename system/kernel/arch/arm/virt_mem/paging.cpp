@@ -6,7 +6,7 @@
 #include <cstring>
 #include <drivers/serial.h>
 #include <feline/logger.h>
-#include <feline/spinlock.h>
+#include <feline/rwlock.h>
 #include <kernel/log.h>
 #include <kernel/mem.h>
 #include <kernel/paging.h>
@@ -84,8 +84,9 @@ map_results unmap_page(page const virt_addr, unsigned int opts);
 
 /* Begin Global Variables */
 
-/* Lock this before modifying any page tables */
-Spinlock modifying_page_tables;
+/* Lock this for writing before modifying any page tables, or for reading
+ * before looking anything up in them */
+RWSpinlock modifying_page_tables;
 
 /* Maximuim amount of virtual memory */
 /* Change for 64-bit */
@@ -291,18 +292,19 @@ static map_results internal_map_range(PhysAddr<void const> const phys_addr,
 map_results map_range(PhysAddr<void const> const phys_addr, size_t len,
                       void const **virt_addr, unsigned int opts) {
 	/* Synchronize access */
-	modifying_page_tables.acquire_lock();
+	modifying_page_tables.acquire_write();
 	/* Round up, instead of down. */
 	len += page_offset(phys_addr);
 	*virt_addr = find_free_virtmem(len);
 	if (*virt_addr == nullptr) {
+		modifying_page_tables.release_write();
 		return map_no_virtmem;
 	}
 	*virt_addr = reinterpret_cast<void *>(
 		reinterpret_cast<uintptr_t>(*virt_addr) + page_offset(phys_addr));
 	/* Set it to the correct offset in the page */
 	map_results temp = internal_map_range(phys_addr, len, *virt_addr, opts);
-	modifying_page_tables.release_lock();
+	modifying_page_tables.release_write();
 	return temp;
 }
 
@@ -315,9 +317,10 @@ map_results map_range(PhysAddr<void> phys_addr, size_t len, void **virt_addr,
 
 /* Mapping a range with nothing specified */
 map_results map_range(size_t len, void **virt_addr, unsigned int opts) {
-	modifying_page_tables.acquire_lock();
+	modifying_page_tables.acquire_write();
 	*virt_addr = find_free_virtmem(len);
 	if (*virt_addr == nullptr) {
+		modifying_page_tables.release_write();
 		return map_no_virtmem;
 	}
 	PhysAddr<void const> const phys_addr;
@@ -325,13 +328,13 @@ map_results map_range(size_t len, void **virt_addr, unsigned int opts) {
 	pmm_results attempt = get_mem_area(phys_addr, len);
 	/* if we are out */
 	if (attempt == pmm_nomem) {
-		modifying_page_tables.release_lock();
+		modifying_page_tables.release_write();
 		/* return the error */
 		return map_no_physmem;
 	}
 	map_results temp;
 	temp = internal_map_range(phys_addr, len, virt_addr, opts);
-	modifying_page_tables.release_lock();
+	modifying_page_tables.release_write();
 	return temp;
 }
 
@@ -355,14 +358,14 @@ map_results unmap_page(page const virt_addr,
 }
 
 map_results unmap_range(void const *virt_addr, size_t len, unsigned int opts) {
-	modifying_page_tables.acquire_lock();
+	modifying_page_tables.acquire_write();
 	/* Loop through */
 	page to_unmap = virt_addr;
 	for (size_t count = 0; count < bytes_to_pages(len); count++, to_unmap++) {
 		/* If anything isn't mapped */
 		if (!isMapped(to_unmap)) {
 			/* Return the error */
-			modifying_page_tables.release_lock();
+			modifying_page_tables.release_write();
 			return map_notmapped;
 		}
 	}
@@ -374,6 +377,7 @@ map_results unmap_range(void const *virt_addr, size_t len, unsigned int opts) {
 		if (attempt == pmm_invalid || attempt == pmm_null) {
 			/* Call it an invalid option because we shouldn't have been managing
 			 * it(TODO: better description) */
+			modifying_page_tables.release_write();
 			return map_invalid_option;
 		}
 	}
@@ -383,12 +387,12 @@ map_results unmap_range(void const *virt_addr, size_t len, unsigned int opts) {
 		/* Actually unmap it */
 		unmap_page(to_unmap, 0);
 	}
-	modifying_page_tables.release_lock();
+	modifying_page_tables.release_write();
 	return map_success;
 }
 
 int setup_paging() {
-	modifying_page_tables.acquire_lock();
+	modifying_page_tables.acquire_write();
 	for (largePage addr = nullptr;
 	     addr.getInt() < MAX_VIRT_MEM - LARGE_CHUNK_SIZE; ++addr) {
 		set_second_level_page_table(
@@ -422,10 +426,41 @@ int setup_paging() {
 	uintptr_t ttbr1 = 0;
 	uintptr_t ttbc = 0; // Always use ttbr0
 	enable_paging(ttbr0, ttbr1, ttbc);
-	modifying_page_tables.release_lock();
+	modifying_page_tables.release_write();
 	return 0;
 }
 
+map_results make_guard_page(void const *virt_addr, unsigned int opts) {
+	modifying_page_tables.acquire_write();
+	if (!isMapped(virt_addr)) {
+		modifying_page_tables.release_write();
+		return map_notmapped;
+	}
+	/* The page is normally part of a bigger PMM area, which can only be
+	 * freed whole */
+	if ((opts & PHYS_ADDR_AUTO) != 0) {
+		modifying_page_tables.release_write();
+		return map_invalid_option;
+	}
+	unmap_page(virt_addr, 0);
+	/* Still "in use" as far as find_free_virtmem is concerned */
+	page_tables_searchable[searchable_page_table_offset(virt_addr)] = true;
+	modifying_page_tables.release_write();
+	return map_success;
+}
+
+bool lookup_phys_addr(void const *virt_addr, PhysAddr<void const> *phys_addr) {
+	uint32_t flags = modifying_page_tables.acquire_read();
+	/* The page tables it would be in may not even exist if it isn't mapped */
+	bool result = isMapped(virt_addr);
+	if (result) {
+		*phys_addr = PhysAddr<void const>(virt_to_phys(virt_addr).as_int() +
+		                                  page_offset(virt_addr));
+	}
+	modifying_page_tables.release_read(flags);
+	return result;
+}
+
 void invlpg(page const addr) {
 	asm volatile("mcr p15, 0, %0, c8, c7, 0" ::"r"(addr.get()) : "memory");
 }
@@ -436,7 +471,7 @@ void dump_pagetables() {
 	page contiguous_phys_addr_start = nullptr;
 	page contiguous_virt_addr_start = nullptr;
 	size_t num_contiguous_mappings = 0;
-	modifying_page_tables.acquire_lock();
+	uint32_t flags = modifying_page_tables.acquire_read();
 	for (page virt_addr = nullptr; virt_addr.getInt() != 0xffc00000;
 	     ++virt_addr) {
 		pt_offset offsets = page_table_offset(virt_addr);
@@ -469,7 +504,7 @@ void dump_pagetables() {
 		prev_virt_addr = virt_addr;
 		prev_phys_addr = phys_addr;
 	}
-	modifying_page_tables.release_lock();
+	modifying_page_tables.release_read(flags);
 	if (num_contiguous_mappings != 0) {
 		printf("%p-%p -> %p-%p (%#llx)\n", contiguous_virt_addr_start.get(),
 		       reinterpret_cast<void *>(prev_virt_addr.getInt() + 0xfff),
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#include <cpuid.h>
+#include <cstdint>
+#include <kernel/asm_compat.h>
+#include <kernel/fpu.h>
+
+#define CR0_MP (1 << 1)
+#define CR0_EM (1 << 2)
+#define CR0_TS (1 << 3)
+#define CR0_NE (1 << 5)
+#define CR4_OSFXSR (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+/* CPUID 1 EDX bits */
+#define CPUID_FXSR (1 << 24)
+#define CPUID_SSE (1 << 25)
+
+/* MXCSR after reset: every exception masked, round to nearest */
+#define DEFAULT_MXCSR 0x1F80
+
+/* The same on every CPU */
+static bool has_fxsr = false;
+static bool has_sse = false;
+
+static uint32_t read_cr0() {
+	uint32_t cr0;
+	__asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+	return cr0;
+}
+static void write_cr0(uint32_t cr0) {
+	__asm__ volatile("mov %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+void arch_init_fpu() {
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		has_fxsr = (edx & CPUID_FXSR) != 0;
+		has_sse = has_fxsr && (edx & CPUID_SSE) != 0;
+	}
+	/* No emulation, and report errors as exceptions rather than through the
+	 * PIC. MP makes wait trap along with the FPU instructions when TS is
+	 * set. */
+	write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+	if (has_fxsr) {
+		uint32_t cr4;
+		__asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+		cr4 |= CR4_OSFXSR | (has_sse ? CR4_OSXMMEXCPT : 0);
+		__asm__ volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+	}
+	__asm__ volatile("fninit");
+	arch_disable_fpu();
+}
+
+void arch_enable_fpu() { __asm__ volatile("clts" : : : "memory"); }
+
+void arch_disable_fpu() { write_cr0(read_cr0() | CR0_TS); }
+
+void arch_reset_fpu() {
+	__asm__ volatile("fninit");
+	/* fninit leaves the SSE state alone */
+	if (has_sse) {
+		uint32_t mxcsr = DEFAULT_MXCSR;
+		__asm__ volatile("ldmxcsr %0" : : "m"(mxcsr));
+	}
+}
+
+/* Where in state the image goes */
+static uint8_t *image(FpuState *state) {
+	auto addr = reinterpret_cast<uintptr_t>(state->image);
+	return reinterpret_cast<uint8_t *>((addr + 15) & ~uintptr_t{15});
+}
+
+void arch_save_fpu(FpuState *state) {
+	uint8_t *area = image(state);
+	if (has_fxsr) {
+		__asm__ volatile("fxsave (%0)" : : "r"(area) : "memory");
+	} else {
+		/* fnsave resets the FPU, but the registers have to stay loaded in
+		 * case the task comes back before anyone else uses it */
+		__asm__ volatile("fnsave (%0)\n\t"
+		                 "frstor (%0)"
+		                 :
+		                 : "r"(area)
+		                 : "memory");
+	}
+}
+
+void arch_restore_fpu(FpuState const *state) {
+	uint8_t *area = image(const_cast<FpuState *>(state));
+	if (has_fxsr) {
+		__asm__ volatile("fxrstor (%0)" : : "r"(area) : "memory");
+	} else {
+		__asm__ volatile("frstor (%0)" : : "r"(area) : "memory");
+	}
+}
+
+/* #NM: an FPU instruction with CR0.TS set */
+ASM void device_not_available_handler() { fpu_trap(); }
@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: MIT */
 /* Copyright (c) 2023 James McNaughton Felder */
 #include "gdt.h"
+#include <kernel/cpu.h>
+#include <kernel/percpu.h>
 #include <kernel/vtopmem.h>
 
 /* target is a pointer to the 8-byte GDT entry */
@@ -35,11 +37,21 @@ void encodeGdtEntry(uint8_t *target, struct GDT source) {
 	target[5] = source.type;
 }
 
-void disable_gdt() {
-	/* TODO: add another for the TSS once we create it. */
-	/* These are generated from utils/gdt_create.c */
-	static uint64_t gdt[] = {0x0000000000000000, 0x00CF9A000000FFFF,
-	                         0x00CF92000000FFFF, 0x00CFFA000000FFFF,
-	                         0x00CFF2000000FFFF};
-	setGdt(gdt, sizeof(gdt));
+/* The first of the entries for each CPU's per-CPU data segment */
+#define PERCPU_GDT_ENTRY 5
+
+/* TODO: add another for the TSS once we create it. */
+/* These are generated from utils/gdt_create.c */
+static uint64_t gdt[PERCPU_GDT_ENTRY + MAX_CPUS] = {
+	0x0000000000000000, 0x00CF9A000000FFFF, 0x00CF92000000FFFF,
+	0x00CFFA000000FFFF, 0x00CFF2000000FFFF};
+
+void disable_gdt() { setGdt(gdt, sizeof(gdt)); }
+
+/* GS gets a flat data segment of its own, based at the offset */
+void arch_set_percpu_offset(unsigned cpu, uintptr_t offset) {
+	encodeGdtEntry(reinterpret_cast<uint8_t *>(&gdt[PERCPU_GDT_ENTRY + cpu]),
+	               {offset, 0xFFFFFFFF, 0x92});
+	uint16_t selector = static_cast<uint16_t>((PERCPU_GDT_ENTRY + cpu) * 8);
+	__asm__ volatile("mov %0, %%gs" : : "r"(selector) : "memory");
 }
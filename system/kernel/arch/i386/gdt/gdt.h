@@ -25,7 +25,8 @@ void encodeGdtEntry(uint8_t *target, struct GDT source);
 /* gdt is the target struct from encodeGDTEntry */
 ASM void setGdt(uint64_t *GDT, unsigned int gdt_size);
 
-/* Creates segments spanning the entire memory for everything. */
+/* Creates segments spanning the entire memory for everything. This resets GS,
+ * so per-CPU data has to be set up again afterwards. */
 void disable_gdt();
 
 #endif /* _KERN_GDT_H */
@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef _KERN_APIC_H
+#define _KERN_APIC_H 1
+
+#include <cstdint>
+#include <kernel/asm_compat.h>
+
+/* Vectors for the interrupts the local APIC raises itself. ISA IRQs are routed
+ * to ISA_IRQ_VECTOR_BASE + irq, the same place PIC_remap puts them. */
+#define ISA_IRQ_VECTOR_BASE 32
+#define LAPIC_TIMER_VECTOR 48
+/* Inter-processor interrupts */
+#define RESCHEDULE_VECTOR 49
+#define TLB_SHOOTDOWN_VECTOR 50
+#define SPURIOUS_VECTOR 0xFF
+
+enum class LapicTimerMode {
+	/* Interrupt once, after the given time */
+	one_shot,
+	/* Keep interrupting, every time the given time passes */
+	periodic,
+};
+
+/* Mask the 8259 PICs, enable this CPU's local APIC and set up the IOAPIC, with
+ * every input masked. Returns false (leaving the PICs alone) if there is no
+ * local APIC. */
+bool init_apic();
+/* Whether init_apic found and enabled the APICs */
+bool apic_enabled();
+/* Enable the local APIC on a CPU other than the one that called init_apic */
+void init_lapic_this_cpu();
+/* This CPU's local APIC ID */
+uint32_t lapic_id();
+/* Tell the local APIC the current interrupt has been handled */
+void lapic_eoi();
+
+/* Work out how fast the local APIC timer runs, using now_ns(), so it needs the
+ * TSC. Must be called before the timer is started. */
+void calibrate_lapic_timer();
+/* Start this CPU's local APIC timer. ns is clamped to what the timer can do. */
+void lapic_timer_start(LapicTimerMode mode, uint64_t ns);
+
+/* Send vector to the CPU with local APIC ID dest */
+void lapic_send_ipi(uint32_t dest, uint8_t vector);
+/* Send vector to every CPU except this one */
+void lapic_send_ipi_others(uint8_t vector);
+/* Reset the CPU with local APIC ID dest, leaving it waiting for a startup
+ * IPI */
+void lapic_send_init(uint32_t dest);
+/* Start the CPU with local APIC ID dest running real mode code at physical
+ * address page << 12 */
+void lapic_send_startup(uint32_t dest, uint8_t page);
+
+/* Send ISA IRQ irq to vector on the CPU with local APIC ID dest, and unmask
+ * it */
+void ioapic_route_irq(uint8_t irq, uint8_t vector, uint32_t dest);
+/* Stop ISA IRQ irq from being delivered */
+void ioapic_mask_irq(uint8_t irq);
+
+/* Interrupt stubs in isr.S */
+ASM void lapic_timer_isr_stub();
+ASM void spurious_isr_stub();
+ASM void reschedule_isr_stub();
+ASM void tlb_shootdown_isr_stub();
+
+#endif /* _KERN_APIC_H */
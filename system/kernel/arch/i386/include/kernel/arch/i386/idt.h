@@ -5,7 +5,9 @@
 
 #include <cstdint>
 
-#define IDT_MAX_DESCRIPTORS 33
+/* The whole table, so vectors can be added after idt_init (the APIC ones are
+ * near the end) */
+#define IDT_MAX_DESCRIPTORS 256
 
 /* Disable interrupts */
 /* Save current instruction */
@@ -36,6 +38,11 @@ static idtr_t idtr
 	__attribute__((used)); /* For use with the lidt instruction */
 
 extern void *isr_stub_table[];
+/* Stubs for the ISA IRQs, by IRQ */
+extern void *irq_stub_table[];
+
+/* Load the IDT idt_init set up on this CPU, for CPUs started after it */
+void idt_load();
 
 // From https://wiki.osdev.org/PIC
 #define PIC1 0x20    /* IO base address for master PIC */
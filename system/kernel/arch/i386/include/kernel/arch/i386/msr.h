@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef _KERN_MSR_H
+#define _KERN_MSR_H 1
+
+#include <cstdint>
+
+#define IA32_APIC_BASE 0x1B
+
+/* Read a model specific register */
+inline uint64_t rdmsr(uint32_t msr) {
+	uint32_t low, high;
+	__asm__ volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+	return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+/* Write a model specific register */
+inline void wrmsr(uint32_t msr, uint64_t value) {
+	__asm__ volatile("wrmsr"
+	                 :
+	                 : "c"(msr), "a"(static_cast<uint32_t>(value)),
+	                   "d"(static_cast<uint32_t>(value >> 32)));
+}
+
+#endif /* _KERN_MSR_H */
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef _KERN_SMP_H
+#define _KERN_SMP_H 1
+
+#include <cstddef>
+#include <cstdint>
+
+/* Fill apic_ids with the local APIC IDs of up to max usable CPUs (including
+ * this one) from the ACPI MADT, and return how many there are. Returns 0 if
+ * there's no MADT. */
+size_t find_cpu_apic_ids(uint32_t *apic_ids, size_t max);
+
+/* Flush this CPU's whole TLB, and record that it has for unmaps waiting on it.
+ * In paging.cpp. */
+void flush_tlb_this_cpu();
+
+#endif /* _KERN_SMP_H */
@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#include <cpuid.h>
+#include <cstdint>
+#include <cstdlib>
+#include <drivers/clocksource.h>
+#include <feline/logger.h>
+#include <feline/spinlock.h>
+#include <kernel/arch/i386/apic.h>
+#include <kernel/arch/i386/idt.h>
+#include <kernel/arch/i386/msr.h>
+#include <kernel/interrupts.h>
+#include <kernel/io.h>
+#include <kernel/paging.h>
+
+#define APIC_BASE_ENABLE (1 << 11)
+#define APIC_BASE_ADDR_MASK 0xFFFFF000
+
+/* Local APIC registers, as byte offsets */
+#define LAPIC_ID 0x20
+#define LAPIC_EOI 0xB0
+#define LAPIC_SPURIOUS 0xF0
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3E0
+
+#define SPURIOUS_ENABLE (1 << 8)
+#define LVT_MASKED (1 << 16)
+#define LVT_TIMER_PERIODIC (1 << 17)
+/* Interrupt command register bits */
+#define ICR_INIT (0b101 << 8)
+#define ICR_STARTUP (0b110 << 8)
+#define ICR_PENDING (1 << 12)
+#define ICR_ASSERT (1 << 14)
+#define ICR_ALL_BUT_SELF (0b11 << 18)
+/* Divide the bus clock by 16 */
+#define TIMER_DIVIDE_16 0b0011
+
+/* TODO: read the address and the ISA overrides from the ACPI MADT. Until then
+ * assume the usual (QEMU's) layout. */
+#define IOAPIC_DEFAULT_BASE 0xFEC00000
+/* IOAPIC registers are accessed through a select and a window register */
+#define IOAPIC_SELECT 0x00
+#define IOAPIC_WINDOW 0x10
+#define IOAPIC_VERSION 0x01
+#define IOAPIC_REDIRECTION(n) (0x10 + 2 * (n))
+#define REDIRECTION_MASKED (1 << 16)
+
+/* How long to count timer ticks for when calibrating */
+#define CALIBRATION_NS 10'000'000
+
+static uint32_t volatile *lapic = nullptr;
+static uint32_t volatile *ioapic = nullptr;
+static unsigned ioapic_num_inputs = 0;
+/* Local APIC timer counts per second, after the divider. The same on every
+ * CPU, since they share the bus clock. */
+static uint64_t lapic_timer_freq = 0;
+/* Every CPU has its own ICR, this just keeps interrupts off between writing its
+ * two halves */
+static Spinlock icr_lock;
+
+static uint32_t lapic_read(uint32_t reg) { return lapic[reg / 4]; }
+static void lapic_write(uint32_t reg, uint32_t value) {
+	lapic[reg / 4] = value;
+}
+
+static uint32_t ioapic_read(uint32_t reg) {
+	ioapic[IOAPIC_SELECT / 4] = reg;
+	return ioapic[IOAPIC_WINDOW / 4];
+}
+static void ioapic_write(uint32_t reg, uint32_t value) {
+	ioapic[IOAPIC_SELECT / 4] = reg;
+	ioapic[IOAPIC_WINDOW / 4] = value;
+}
+
+/* The IOAPIC input an ISA IRQ comes in on. TODO: use the MADT's overrides */
+static unsigned isa_irq_to_gsi(uint8_t irq) {
+	/* The PIT is wired to input 2 (where the cascade would be on the PICs) */
+	return irq == 0 ? 2 : irq;
+}
+
+template <typename T> static T volatile *map_mmio(uintptr_t phys_addr) {
+	void *mapped;
+	auto result =
+		map_range(PhysAddr<void>(phys_addr), 4_KiB, &mapped, MAP_DEVICE);
+	if (result != map_success) {
+		kCritical() << "Unable to map the APIC at " << hex(phys_addr);
+		std::abort();
+	}
+	return static_cast<T volatile *>(mapped);
+}
+
+void init_lapic_this_cpu() {
+	wrmsr(IA32_APIC_BASE, rdmsr(IA32_APIC_BASE) | APIC_BASE_ENABLE);
+	lapic_write(LAPIC_SPURIOUS, SPURIOUS_ENABLE | SPURIOUS_VECTOR);
+	/* Nothing until someone starts it */
+	lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_TIMER_VECTOR);
+	lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+}
+
+bool init_apic() {
+	unsigned int eax, ebx, ecx, edx;
+	/* EDX bit 9 is the local APIC */
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (edx & (1 << 9)) == 0) {
+		return false;
+	}
+	lapic = map_mmio<uint32_t>(rdmsr(IA32_APIC_BASE) & APIC_BASE_ADDR_MASK);
+	idt_set_descriptor(LAPIC_TIMER_VECTOR,
+	                   reinterpret_cast<void *>(lapic_timer_isr_stub),
+	                   IDT_INTERRUPT_GATE);
+	idt_set_descriptor(RESCHEDULE_VECTOR,
+	                   reinterpret_cast<void *>(reschedule_isr_stub),
+	                   IDT_INTERRUPT_GATE);
+	idt_set_descriptor(TLB_SHOOTDOWN_VECTOR,
+	                   reinterpret_cast<void *>(tlb_shootdown_isr_stub),
+	                   IDT_INTERRUPT_GATE);
+	idt_set_descriptor(SPURIOUS_VECTOR,
+	                   reinterpret_cast<void *>(spurious_isr_stub),
+	                   IDT_INTERRUPT_GATE);
+	init_lapic_this_cpu();
+
+	/* Everything comes through the APICs from now on. The PICs stay remapped
+	 * so anything they still raise doesn't look like an exception. */
+	outb(PIC1_DATA, 0xFF);
+	outb(PIC2_DATA, 0xFF);
+
+	ioapic = map_mmio<uint32_t>(IOAPIC_DEFAULT_BASE);
+	ioapic_num_inputs = ((ioapic_read(IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+	for (unsigned input = 0; input < ioapic_num_inputs; ++input) {
+		ioapic_write(IOAPIC_REDIRECTION(input), REDIRECTION_MASKED);
+		ioapic_write(IOAPIC_REDIRECTION(input) + 1, 0);
+	}
+	kLog() << "Using the APICs (IOAPIC with " << dec(ioapic_num_inputs)
+		   << " inputs)";
+	return true;
+}
+
+bool apic_enabled() { return lapic != nullptr; }
+
+uint32_t lapic_id() { return lapic_read(LAPIC_ID) >> 24; }
+
+void lapic_eoi() { lapic_write(LAPIC_EOI, 0); }
+
+/* Writing the low half sends it */
+static void send_icr(uint32_t dest, uint32_t command) {
+	icr_lock.acquire_lock();
+	while ((lapic_read(LAPIC_ICR_LOW) & ICR_PENDING) != 0) {
+	}
+	lapic_write(LAPIC_ICR_HIGH, dest << 24);
+	lapic_write(LAPIC_ICR_LOW, command);
+	icr_lock.release_lock();
+}
+
+void lapic_send_ipi(uint32_t dest, uint8_t vector) {
+	send_icr(dest, ICR_ASSERT | vector);
+}
+
+void lapic_send_ipi_others(uint8_t vector) {
+	send_icr(0, ICR_ALL_BUT_SELF | ICR_ASSERT | vector);
+}
+
+void lapic_send_init(uint32_t dest) {
+	send_icr(dest, ICR_INIT | ICR_ASSERT);
+}
+
+void lapic_send_startup(uint32_t dest, uint8_t page) {
+	send_icr(dest, ICR_STARTUP | ICR_ASSERT | page);
+}
+
+void calibrate_lapic_timer() {
+	/* init_timers only gets here with the TSC, so now_ns() is precise */
+	lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_TIMER_VECTOR);
+	lapic_write(LAPIC_TIMER_INITIAL, UINT32_MAX);
+	uint64_t start = now_ns();
+	while (now_ns() - start < CALIBRATION_NS) {
+	}
+	uint32_t counted = UINT32_MAX - lapic_read(LAPIC_TIMER_CURRENT);
+	lapic_write(LAPIC_TIMER_INITIAL, 0);
+	lapic_timer_freq = uint64_t{counted} * 1'000'000'000 / CALIBRATION_NS;
+	kLog() << "Local APIC timer runs at " << dec(lapic_timer_freq / 1'000)
+		   << "KHz";
+}
+
+void lapic_timer_start(LapicTimerMode mode, uint64_t ns) {
+	uint64_t max_ns = uint64_t{UINT32_MAX} * 1'000'000'000 / lapic_timer_freq;
+	uint64_t count = ns > max_ns ? UINT32_MAX
+	                             : ns * lapic_timer_freq / 1'000'000'000;
+	if (count == 0) {
+		count = 1;
+	}
+	uint32_t lvt = LAPIC_TIMER_VECTOR;
+	if (mode == LapicTimerMode::periodic) {
+		lvt |= LVT_TIMER_PERIODIC;
+	}
+	lapic_write(LAPIC_LVT_TIMER, lvt);
+	/* Writing the initial count (re)starts it */
+	lapic_write(LAPIC_TIMER_INITIAL, static_cast<uint32_t>(count));
+}
+
+void ioapic_route_irq(uint8_t irq, uint8_t vector, uint32_t dest) {
+	unsigned input = isa_irq_to_gsi(irq);
+	if (input >= ioapic_num_inputs) {
+		kError() << "The IOAPIC has no input for IRQ " << dec(irq);
+		return;
+	}
+	/* Fixed delivery to one physical APIC ID, edge triggered, active high */
+	ioapic_write(IOAPIC_REDIRECTION(input) + 1, dest << 24);
+	ioapic_write(IOAPIC_REDIRECTION(input), vector);
+}
+
+void ioapic_mask_irq(uint8_t irq) {
+	unsigned input = isa_irq_to_gsi(irq);
+	if (input >= ioapic_num_inputs) {
+		return;
+	}
+	ioapic_write(IOAPIC_REDIRECTION(input),
+	             ioapic_read(IOAPIC_REDIRECTION(input)) | REDIRECTION_MASKED);
+}
@@ -1,9 +1,11 @@
 /* SPDX-License-Identifier: MIT */
 /* Copyright (c) 2023 James McNaughton Felder */
 #include <cinttypes>
+#include <kernel/arch/i386/apic.h>
 #include <kernel/arch/i386/idt.h>
 #include <kernel/interrupts.h>
 #include <kernel/io.h>
+#include <kernel/irq.h>
 #include <kernel/log.h>
 
 /* This is a basic stub to be called by any Interrupt Service Routine */
@@ -28,8 +30,12 @@ void idt_init() {
 	}
 	/* And one trap for our syscall */
 	idt_set_descriptor(31, isr_stub_table[31], IDT_TRAP_GATE);
-	/* And an interrupt for the PIT */
-	idt_set_descriptor(32, isr_stub_table[32], IDT_INTERRUPT_GATE);
+	/* And the ISA IRQs, which are the same vectors whether they come from the
+	 * PICs or the IOAPIC */
+	for (uint8_t irq = 0; irq < NUM_IRQS; irq++) {
+		idt_set_descriptor(ISA_IRQ_VECTOR_BASE + irq, irq_stub_table[irq],
+		                   IDT_INTERRUPT_GATE);
+	}
 
 	__asm__ volatile("mov $0xff, %al");             /* Disable the pic */
 	__asm__ volatile("out %al, $0xa1");             /* Disable the pic */
@@ -37,8 +43,11 @@ void idt_init() {
 	__asm__ volatile("lidt %0" : : "memory"(idtr)); /* load the new IDT */
 	__asm__ volatile("sti");                        /* set the interrupt flag */
 
-	/* Map the timer interrupt to 32 */
-	PIC_remap(32, 40);
+	PIC_remap(ISA_IRQ_VECTOR_BASE, ISA_IRQ_VECTOR_BASE + 8);
+}
+
+void idt_load() {
+	__asm__ volatile("lidt %0" : : "memory"(idtr));
 }
 
 // From https://wiki.osdev.org/PIC
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#include <cstdint>
+#include <kernel/arch/i386/apic.h>
+#include <kernel/arch/i386/idt.h>
+#include <kernel/asm_compat.h>
+#include <kernel/io.h>
+#include <kernel/irq.h>
+
+/* ISA IRQs go to whichever CPU requested them */
+void arch_enable_irq(unsigned line) {
+	if (apic_enabled()) {
+		ioapic_route_irq(static_cast<uint8_t>(line),
+		                 static_cast<uint8_t>(ISA_IRQ_VECTOR_BASE + line),
+		                 lapic_id());
+	} else {
+		IRQ_clear_mask(static_cast<unsigned char>(line));
+	}
+}
+
+void arch_disable_irq(unsigned line) {
+	if (apic_enabled()) {
+		ioapic_mask_irq(static_cast<uint8_t>(line));
+	} else {
+		IRQ_add_mask(static_cast<unsigned char>(line));
+	}
+}
+
+/* Called by every ISA IRQ's stub in isr.S */
+ASM void isa_irq_handler(unsigned irq) {
+	/* They're edge triggered, so acknowledge first: irq_exit can switch tasks
+	 * and not come back for a while */
+	if (apic_enabled()) {
+		lapic_eoi();
+	} else {
+		if (irq >= 8) {
+			outb(PIC2_COMMAND, PIC_EOI);
+		}
+		outb(PIC1_COMMAND, PIC_EOI);
+	}
+	dispatch_irq(irq);
+	irq_exit();
+}
@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#include <cstdint>
+#include <cstring>
+#include <feline/fixed_width.h>
+#include <feline/logger.h>
+#include <kernel/arch/i386/smp.h>
+#include <kernel/paging.h>
+#include <kernel/vtopmem.h>
+
+/* Only the RSDT is used, every version of ACPI has one */
+
+/* Where the BIOS data area keeps the EBDA's segment */
+#define EBDA_SEGMENT_PTR 0x40E
+/* Where the RSDP can be if it isn't in the EBDA */
+#define BIOS_ROM_START 0xE0000
+#define BIOS_ROM_END 0x100000
+
+#define MADT_LOCAL_APIC 0
+#define LOCAL_APIC_ENABLED (1 << 0)
+
+struct [[gnu::packed]] Rsdp {
+		char signature[8];
+		uint8_t checksum;
+		char oem_id[6];
+		uint8_t revision;
+		uint32_t rsdt_address;
+};
+
+struct [[gnu::packed]] SdtHeader {
+		char signature[4];
+		uint32_t length;
+		uint8_t revision;
+		uint8_t checksum;
+		char oem_id[6];
+		char oem_table_id[8];
+		uint32_t oem_revision;
+		uint32_t creator_id;
+		uint32_t creator_revision;
+};
+
+struct [[gnu::packed]] Madt {
+		SdtHeader header;
+		uint32_t lapic_address;
+		uint32_t flags;
+};
+
+/* Every MADT entry starts with this */
+struct [[gnu::packed]] MadtEntry {
+		uint8_t type;
+		uint8_t length;
+};
+
+struct [[gnu::packed]] MadtLocalApic {
+		MadtEntry entry;
+		uint8_t processor_id;
+		uint8_t apic_id;
+		uint32_t flags;
+};
+
+/* Map len bytes of physical memory to read, or return nullptr */
+static void const *map_table(uintptr_t phys_addr, size_t len) {
+	void const *mapped;
+	if (map_range(PhysAddr<void const>(phys_addr), len, &mapped, 0) !=
+	    map_success) {
+		kError() << "Unable to map ACPI data at " << hex(phys_addr);
+		return nullptr;
+	}
+	return mapped;
+}
+
+static void unmap_table(void const *mapped, size_t len) {
+	/* map_range rounded the start down to a page */
+	unmap_range(mapped,
+	            len + (reinterpret_cast<uintptr_t>(mapped) & (4_KiB - 1)), 0);
+}
+
+/* ACPI structures' bytes add up to 0 */
+static bool checksum_ok(void const *data, size_t len) {
+	uint8_t sum = 0;
+	for (size_t i = 0; i < len; ++i) {
+		sum += static_cast<uint8_t const *>(data)[i];
+	}
+	return sum == 0;
+}
+
+/* The RSDP is on a 16 byte boundary. Returns its address or 0. */
+static uintptr_t find_rsdp_in(uintptr_t start, size_t len) {
+	auto const *area = static_cast<char const *>(map_table(start, len));
+	if (!area) {
+		return 0;
+	}
+	uintptr_t found = 0;
+	for (size_t offset = 0; offset + sizeof(Rsdp) <= len; offset += 16) {
+		if (memcmp(area + offset, "RSD PTR ", 8) == 0 &&
+		    checksum_ok(area + offset, sizeof(Rsdp))) {
+			found = start + offset;
+			break;
+		}
+	}
+	unmap_table(area, len);
+	return found;
+}
+
+/* It's either in the first KiB of the EBDA, or in the BIOS ROM */
+static uintptr_t find_rsdp() {
+	uintptr_t ebda =
+		uintptr_t{read_pmem(PhysAddr<uint16_t const>(EBDA_SEGMENT_PTR))} << 4;
+	uintptr_t rsdp = ebda != 0 ? find_rsdp_in(ebda, 1_KiB) : 0;
+	if (rsdp == 0) {
+		rsdp = find_rsdp_in(BIOS_ROM_START, BIOS_ROM_END - BIOS_ROM_START);
+	}
+	return rsdp;
+}
+
+/* Map a whole table, or return nullptr if it's corrupt */
+static SdtHeader const *map_sdt(uintptr_t phys_addr) {
+	auto const *header =
+		static_cast<SdtHeader const *>(map_table(phys_addr, sizeof(SdtHeader)));
+	if (!header) {
+		return nullptr;
+	}
+	uint32_t len = header->length;
+	unmap_table(header, sizeof(SdtHeader));
+	if (len < sizeof(SdtHeader)) {
+		return nullptr;
+	}
+	header = static_cast<SdtHeader const *>(map_table(phys_addr, len));
+	if (header && !checksum_ok(header, len)) {
+		kWarning() << "Ignoring ACPI table at " << hex(phys_addr)
+				   << " with a bad checksum";
+		unmap_table(header, len);
+		return nullptr;
+	}
+	return header;
+}
+
+static size_t read_madt(Madt const *madt, uint32_t *apic_ids, size_t max) {
+	size_t found = 0;
+	auto const *entries = reinterpret_cast<char const *>(madt + 1);
+	auto const *end = reinterpret_cast<char const *>(madt) + madt->header.length;
+	while (entries + sizeof(MadtEntry) <= end) {
+		auto const *entry = reinterpret_cast<MadtEntry const *>(entries);
+		if (entry->length < sizeof(MadtEntry)) {
+			break;
+		}
+		if (entry->type == MADT_LOCAL_APIC &&
+		    entry->length >= sizeof(MadtLocalApic)) {
+			auto const *cpu = reinterpret_cast<MadtLocalApic const *>(entry);
+			/* Disabled ones (even if they're online capable) are empty
+			 * hotplug slots, which would never answer a startup IPI */
+			if ((cpu->flags & LOCAL_APIC_ENABLED) != 0) {
+				if (found == max) {
+					kWarning() << "Only using the first " << dec(max)
+							   << " CPUs";
+					break;
+				}
+				apic_ids[found++] = cpu->apic_id;
+			}
+		}
+		entries += entry->length;
+	}
+	return found;
+}
+
+size_t find_cpu_apic_ids(uint32_t *apic_ids, size_t max) {
+	uintptr_t rsdp_addr = find_rsdp();
+	if (rsdp_addr == 0) {
+		kLog() << "No ACPI tables found";
+		return 0;
+	}
+	Rsdp rsdp = read_pmem(PhysAddr<Rsdp const>(rsdp_addr));
+	SdtHeader const *rsdt = map_sdt(rsdp.rsdt_address);
+	if (!rsdt) {
+		return 0;
+	}
+	uint32_t rsdt_len = rsdt->length;
+	size_t num_tables = (rsdt_len - sizeof(SdtHeader)) / sizeof(uint32_t);
+	size_t found = 0;
+	for (size_t i = 0; i < num_tables; ++i) {
+		/* The entries after the header aren't necessarily aligned */
+		uint32_t table_addr;
+		memcpy(&table_addr,
+		       reinterpret_cast<char const *>(rsdt + 1) + i * sizeof(uint32_t),
+		       sizeof(uint32_t));
+		SdtHeader const *table = map_sdt(table_addr);
+		if (!table) {
+			continue;
+		}
+		bool is_madt = memcmp(table->signature, "APIC", 4) == 0;
+		if (is_madt) {
+			found = read_madt(reinterpret_cast<Madt const *>(table), apic_ids,
+			                  max);
+		}
+		unmap_table(table, table->length);
+		if (is_madt) {
+			break;
+		}
+	}
+	unmap_table(rsdt, rsdt_len);
+	return found;
+}
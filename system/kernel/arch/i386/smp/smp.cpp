@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#include "../gdt/gdt.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <drivers/clocksource.h>
+#include <feline/fixed_width.h>
+#include <feline/logger.h>
+#include <kernel/arch/i386/apic.h>
+#include <kernel/arch/i386/idt.h>
+#include <kernel/arch/i386/smp.h>
+#include <kernel/asm_compat.h>
+#include <kernel/cpu.h>
+#include <kernel/deferred_work.h>
+#include <kernel/fpu.h>
+#include <kernel/irq.h>
+#include <kernel/mem.h>
+#include <kernel/paging.h>
+#include <kernel/percpu.h>
+#include <kernel/scheduler.h>
+#include <kernel/task.h>
+
+/* Where a startup IPI can start a CPU: a page below 1MiB. Stay clear of the
+ * EBDA above and the BIOS's data below. */
+#define TRAMPOLINE_SEARCH_TOP 0x9E000
+#define TRAMPOLINE_SEARCH_BOTTOM 0x8000
+
+/* How long to wait after INIT, between startup IPIs, and for a CPU to come
+ * up */
+#define INIT_DELAY_NS 10'000'000
+#define STARTUP_DELAY_NS 200'000
+#define AP_START_TIMEOUT_NS 1'000'000'000
+
+/* A 4MiB, present, writeable page at 0 */
+#define IDENTITY_MAP_PDE 0x83
+
+/* In ap_boot.S */
+ASM char const ap_trampoline_start[];
+ASM char const ap_trampoline_pm[];
+ASM char const ap_trampoline_data[];
+ASM char const ap_trampoline_end[];
+ASM char const ap_trampoline_high[];
+
+/* Filled in for each CPU at ap_trampoline_data */
+struct [[gnu::packed]] ApTrampolineData {
+		/* For lgdt */
+		uint16_t gdt_limit;
+		uint32_t gdt_base;
+		/* For the far jump to 32-bit code */
+		uint32_t pm_entry;
+		uint16_t pm_selector;
+		/* Identity maps the trampoline, and maps the kernel */
+		uint32_t cr3;
+		uint32_t stack_top;
+		/* ap_trampoline_high, and ap_main's argument */
+		uint32_t entry;
+		uint32_t cpu;
+		/* The kernel's page directory */
+		uint32_t kernel_cr3;
+		uint64_t gdt[3];
+};
+static_assert(offsetof(ApTrampolineData, cr3) == 12 &&
+                  offsetof(ApTrampolineData, cpu) == 24 &&
+                  offsetof(ApTrampolineData, kernel_cr3) == 28 &&
+                  sizeof(ApTrampolineData) == 56,
+              "Keep ApTrampolineData in sync with ap_boot.S");
+
+/* Local APIC IDs, by CPU number */
+static uint32_t cpu_apic_ids[MAX_CPUS];
+/* How many of them belong to CPUs that have started, so can be sent IPIs */
+static std::atomic<unsigned> num_cpu_ids{1};
+
+/* What the CPU being started needs, which it's done with once it sets
+ * ap_started */
+static TaskAllocation ap_boot_stack;
+static std::atomic<bool> ap_started;
+
+void kick_cpu(unsigned cpu) {
+	if (cpu < num_cpu_ids.load(std::memory_order_acquire)) {
+		lapic_send_ipi(cpu_apic_ids[cpu], RESCHEDULE_VECTOR);
+	}
+}
+
+ASM void reschedule_isr_handler() {
+	lapic_eoi();
+	scheduler_handle_tick();
+	irq_exit();
+}
+
+static void delay_ns(uint64_t ns) {
+	uint64_t start = now_ns();
+	while (now_ns() - start < ns) {
+		cpu_relax();
+	}
+}
+
+/* Each CPU starts here, from ap_boot.S, with interrupts disabled and already
+ * on the kernel's page directory */
+ASM [[noreturn]] void ap_main(unsigned cpu);
+void ap_main(unsigned cpu) {
+	disable_gdt();
+	init_percpu(cpu);
+	idt_load();
+	init_lapic_this_cpu();
+	init_scheduler(ap_boot_stack);
+	init_fpu();
+	init_deferred_work();
+	/* Nothing it unmapped before now can be in its TLB */
+	flush_tlb_this_cpu();
+	cpus_online.fetch_add(1);
+	ap_started.store(true);
+	kLog() << "CPU " << dec(cpu) << " (local APIC " << dec(lapic_id())
+		   << ") started";
+	lapic_timer_start(LapicTimerMode::periodic, 1'000'000);
+	/* Become the idle task */
+	end_cur_task();
+}
+
+/* Take the highest free page a startup IPI can start a CPU in, or return 0 */
+static uintptr_t claim_trampoline_page() {
+	for (uintptr_t addr = TRAMPOLINE_SEARCH_TOP;
+	     addr >= TRAMPOLINE_SEARCH_BOTTOM; addr -= 4_KiB) {
+		if (get_mem_area(PhysAddr<void const>(addr), 4_KiB) == pmm_success) {
+			return addr;
+		}
+	}
+	return 0;
+}
+
+/* Send INIT and up to two startup IPIs, as Intel says to, and wait for it to
+ * set ap_started */
+static bool start_cpu(uint32_t apic_id, uintptr_t trampoline) {
+	ap_started.store(false);
+	lapic_send_init(apic_id);
+	delay_ns(INIT_DELAY_NS);
+	for (int attempt = 0; attempt < 2 && !ap_started.load(); ++attempt) {
+		lapic_send_startup(apic_id, static_cast<uint8_t>(trampoline >> 12));
+		delay_ns(STARTUP_DELAY_NS);
+	}
+	uint64_t start = now_ns();
+	while (!ap_started.load()) {
+		if (now_ns() - start > AP_START_TIMEOUT_NS) {
+			return false;
+		}
+		cpu_relax();
+	}
+	return true;
+}
+
+void start_other_cpus() {
+	if (!apic_enabled()) {
+		return;
+	}
+	uint32_t apic_ids[MAX_CPUS];
+	size_t num_found = find_cpu_apic_ids(apic_ids, MAX_CPUS);
+	if (num_found <= 1) {
+		return;
+	}
+	cpu_apic_ids[0] = lapic_id();
+
+	uintptr_t trampoline = claim_trampoline_page();
+	void *trampoline_page = nullptr;
+	void *page_directory = nullptr;
+	PhysAddr<void const> page_directory_phys;
+	if (trampoline == 0 ||
+	    map_range(PhysAddr<void>(trampoline), 4_KiB, &trampoline_page, 0) !=
+	        map_success ||
+	    get_mem(&page_directory, 4_KiB) != mem_success ||
+	    !lookup_phys_addr(page_directory, &page_directory_phys)) {
+		kError() << "Unable to set up for starting the other CPUs";
+		return;
+	}
+	/* The kernel's page directory, through the recursive mapping, plus the
+	 * identity mapping the trampoline needs to turn paging on */
+	memcpy(page_directory, reinterpret_cast<void const *>(0xFFFFF000), 4_KiB);
+	static_cast<uint32_t *>(page_directory)[0] = IDENTITY_MAP_PDE;
+
+	memcpy(trampoline_page, ap_trampoline_start,
+	       static_cast<size_t>(ap_trampoline_end - ap_trampoline_start));
+	uintptr_t data_offset =
+		static_cast<uintptr_t>(ap_trampoline_data - ap_trampoline_start);
+	auto *data = reinterpret_cast<ApTrampolineData *>(
+		static_cast<char *>(trampoline_page) + data_offset);
+	/* The same flat code and data segments as disable_gdt */
+	data->gdt[0] = 0;
+	data->gdt[1] = 0x00CF9A000000FFFF;
+	data->gdt[2] = 0x00CF92000000FFFF;
+	data->gdt_limit = sizeof(data->gdt) - 1;
+	data->gdt_base = static_cast<uint32_t>(
+		trampoline + data_offset + offsetof(ApTrampolineData, gdt));
+	data->pm_entry = static_cast<uint32_t>(
+		trampoline +
+		static_cast<uintptr_t>(ap_trampoline_pm - ap_trampoline_start));
+	data->pm_selector = 0x08;
+	data->cr3 = static_cast<uint32_t>(page_directory_phys.as_int());
+	/* The stack can be anywhere in the kernel's page directory, so the CPU
+	 * switches to it before touching the stack (which also lets the
+	 * trampoline's page directory be freed) */
+	uint32_t kernel_cr3;
+	__asm__ volatile("mov %%cr3, %0" : "=r"(kernel_cr3));
+	data->kernel_cr3 = kernel_cr3;
+	data->entry = reinterpret_cast<uintptr_t>(ap_trampoline_high);
+
+	bool all_started = true;
+	for (size_t i = 0; i < num_found; ++i) {
+		if (apic_ids[i] == cpu_apic_ids[0]) {
+			continue;
+		}
+		unsigned cpu = num_cpu_ids.load();
+		ap_boot_stack = create_new_stack();
+		data->stack_top = reinterpret_cast<uintptr_t>(ap_boot_stack.addr) +
+		                  ap_boot_stack.len;
+		data->cpu = cpu;
+		if (!start_cpu(apic_ids[i], trampoline)) {
+			/* It might still turn up, so leave everything it could use
+			 * alone */
+			kError() << "CPU with local APIC " << dec(apic_ids[i])
+					 << " didn't start, giving up on the rest";
+			all_started = false;
+			break;
+		}
+		/* kick_cpu skipped it until now, but it starts with a periodic tick
+		 * so it can't miss anything for long */
+		cpu_apic_ids[cpu] = apic_ids[i];
+		num_cpu_ids.store(cpu + 1, std::memory_order_release);
+	}
+	if (all_started) {
+		unmap_range(trampoline_page, 4_KiB, 0);
+		free_mem_area(PhysAddr<void const>(trampoline), 4_KiB);
+		free_mem(page_directory, 4_KiB);
+	}
+	kLog() << "Running on " << dec(cpus_online.load()) << " CPUs";
+}
@@ -1,11 +1,16 @@
 /* SPDX-License-Identifier: MIT */
 /* Copyright (c) 2023 James McNaughton Felder */
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <feline/spinlock.h>
+#include <feline/rwlock.h>
+#include <kernel/arch/i386/apic.h>
+#include <kernel/arch/i386/smp.h>
+#include <kernel/asm_compat.h>
+#include <kernel/cpu.h>
 #include <kernel/log.h>
 #include <kernel/mem.h>
 #include <kernel/paging.h>
@@ -164,8 +169,9 @@ inline PhysAddr<void> virt_to_phys(void const *const virt_addr) {
 
 /* Begin Global Variables */
 
-/* Lock this before modifying any page tables */
-Spinlock modifying_page_tables;
+/* Lock this for writing before modifying any page tables, or for reading
+ * before looking anything up in them */
+RWSpinlock modifying_page_tables;
 
 /* Only take the address of these! */
 extern char const kernel_start;
@@ -187,8 +193,92 @@ page_table_entry *page_tables = *all_page_tables;
 /* Keep in sync with the CPU's page tables! */
 bool page_tables_searchable[MAX_VIRT_MEM / PHYS_MEM_CHUNK_SIZE] = {false};
 
+/* Other CPUs can have TLB entries for pages unmapped here, and invlpg only
+ * works on this one. Rather than wait for them (while holding locks they might
+ * want), unmapped addresses stay reserved until every CPU has flushed its TLB
+ * since, which the TLB shootdown IPI makes them do. */
+struct DeferredUnmap {
+		size_t first_page;
+		size_t num_pages;
+		/* Every CPU has to have flushed at this tlb_epoch or later */
+		uint32_t epoch;
+};
+#define MAX_DEFERRED_UNMAPS 256
+static DeferredUnmap deferred_unmaps[MAX_DEFERRED_UNMAPS];
+static size_t num_deferred_unmaps = 0;
+/* Bumped every time other CPUs are told to flush */
+static std::atomic<uint32_t> tlb_epoch{0};
+/* The tlb_epoch each CPU last flushed its TLB at */
+static std::atomic<uint32_t> flushed_epoch[MAX_CPUS];
+
 /* End Global Variables */
 
+void flush_tlb_this_cpu() {
+	/* Read first, so anything unmapped before this epoch is already out of
+	 * the page tables when we flush */
+	uint32_t epoch = tlb_epoch.load();
+	uint32_t cr3;
+	__asm__ volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r"(cr3) : : "memory");
+	flushed_epoch[cpu_id()].store(epoch, std::memory_order_release);
+}
+
+ASM void tlb_shootdown_isr_handler() {
+	flush_tlb_this_cpu();
+	lapic_eoi();
+}
+
+/* Tell every other CPU to flush its TLB, after changing page tables, and return
+ * the epoch they'll have flushed at once they have. Doesn't wait for them. */
+static uint32_t shoot_down_tlbs() {
+	uint32_t epoch = tlb_epoch.fetch_add(1) + 1;
+	flush_tlb_this_cpu();
+	lapic_send_ipi_others(TLB_SHOOTDOWN_VECTOR);
+	return epoch;
+}
+
+/* Epochs wrap around, so compare the difference */
+static bool flushed_everywhere(uint32_t epoch) {
+	for (unsigned cpu = 0; cpu < cpus_online.load(); ++cpu) {
+		uint32_t flushed = flushed_epoch[cpu].load(std::memory_order_acquire);
+		if (static_cast<int32_t>(flushed - epoch) < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Let find_free_virtmem have the deferred unmaps no CPU can still have in its
+ * TLB */
+/* Don't call this function if you haven't locked `modifying_page_tables` */
+static void release_deferred_unmaps() {
+	size_t kept = 0;
+	for (size_t i = 0; i < num_deferred_unmaps; ++i) {
+		DeferredUnmap const &unmap = deferred_unmaps[i];
+		if (flushed_everywhere(unmap.epoch)) {
+			memset(&page_tables_searchable[unmap.first_page], false,
+			       sizeof(*page_tables_searchable) * unmap.num_pages);
+		} else {
+			deferred_unmaps[kept++] = unmap;
+		}
+	}
+	num_deferred_unmaps = kept;
+}
+
+/* Keep num_pages pages from first_page reserved until every CPU has flushed at
+ * epoch */
+/* Don't call this function if you haven't locked `modifying_page_tables` */
+static void defer_unmap(size_t first_page, size_t num_pages, uint32_t epoch) {
+	if (num_deferred_unmaps == MAX_DEFERRED_UNMAPS) {
+		release_deferred_unmaps();
+	}
+	if (num_deferred_unmaps == MAX_DEFERRED_UNMAPS) {
+		/* Some CPU has had interrupts off for a very long time */
+		kwarn("Too many unmaps waiting for TLB flushes, leaking the addresses");
+		return;
+	}
+	deferred_unmaps[num_deferred_unmaps++] = {first_page, num_pages, epoch};
+}
+
 /* Don't call this function if you haven't locked `modifying_page_tables` */
 bool isMapped(page const virt_addr) {
 	/* If the page table is present */
@@ -230,6 +320,9 @@ bool free_from_here(page virt_addr_base, size_t needed) {
 
 /* Find len bytes of unmapped memory */
 void *find_free_virtmem(size_t len) {
+	if (num_deferred_unmaps != 0) {
+		release_deferred_unmaps();
+	}
 	/* Loop through all of the virtual memory */
 	for (page base = 4_KiB;
 	     base.getInt() < (MAX_VIRT_MEM - PHYS_MEM_CHUNK_SIZE) && !base.isNull();
@@ -292,6 +385,11 @@ map_results map_page(page const phys_addr, page const virt_addr,
 	unset_bit(cur_pte, WRITE_THROUGH); /* Write-back caching */
 	unset_bit(cur_pte, USER);          /* Default kernelspace */
 	set_bit(cur_pte, WRITEABLE);       /* Default writeable */
+	if ((opts & MAP_DEVICE) != 0) {
+		/* Device registers must see every access */
+		set_bit(cur_pte, CACHE_DISABLE);
+		set_bit(cur_pte, WRITE_THROUGH);
+	}
 	set_bit(cur_pte, PRESENT);         /* It is useable */
 	page_tables_searchable[searchable_page_table_offset(virt_addr)] = true;
 	assert(isMapped(virt_addr));
@@ -364,11 +462,12 @@ static map_results internal_map_range(PhysAddr<void const> phys_addr,
 /* Mapping a range with only phys_addr specified */
 map_results map_range(PhysAddr<void const> phys_addr, size_t len,
                       void const **virt_addr, unsigned int opts) {
-	modifying_page_tables.acquire_lock();
+	modifying_page_tables.acquire_write();
 	/* Round up, instead of down. */
 	len += page_offset(phys_addr.as_int());
 	*virt_addr = find_free_virtmem(len);
 	if (*virt_addr == nullptr) {
+		modifying_page_tables.release_write();
 		return map_no_virtmem;
 	}
 	/* Set it to the correct offset in the page */
@@ -376,7 +475,7 @@ map_results map_range(PhysAddr<void const> phys_addr, size_t len,
 		reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(*virt_addr) +
 	                             page_offset(phys_addr.as_int()));
 	map_results temp = internal_map_range(phys_addr, len, *virt_addr, opts);
-	modifying_page_tables.release_lock();
+	modifying_page_tables.release_write();
 	return temp;
 }
 
@@ -389,10 +488,10 @@ map_results map_range(PhysAddr<void> phys_addr, size_t len, void **virt_addr,
 
 /* Mapping a range with nothing specified */
 map_results map_range(size_t len, void const **virt_addr, unsigned int opts) {
-	modifying_page_tables.acquire_lock();
+	modifying_page_tables.acquire_write();
 	*virt_addr = find_free_virtmem(len);
 	if (*virt_addr == nullptr) {
-		modifying_page_tables.release_lock();
+		modifying_page_tables.release_write();
 		return map_no_virtmem;
 	}
 	PhysAddr<void const> phys_addr;
@@ -400,13 +499,13 @@ map_results map_range(size_t len, void const **virt_addr, unsigned int opts) {
 	pmm_results attempt = get_mem_area(&phys_addr, len);
 	/* if we are out */
 	if (attempt == pmm_nomem) {
-		modifying_page_tables.release_lock();
+		modifying_page_tables.release_write();
 		/* return the error */
 		return map_no_physmem;
 	}
 	map_results temp;
 	temp = internal_map_range(phys_addr, len, virt_addr, opts);
-	modifying_page_tables.release_lock();
+	modifying_page_tables.release_write();
 	return temp;
 }
 
@@ -435,14 +534,14 @@ map_results unmap_page(page const virt_addr,
 
 map_results unmap_range(void const *const virt_addr, size_t len,
                         unsigned int opts [[maybe_unused]]) {
-	modifying_page_tables.acquire_lock();
+	modifying_page_tables.acquire_write();
 	/* Loop through */
 	page to_unmap = virt_addr;
 	for (size_t count = 0; count < bytes_to_pages(len); count++, to_unmap++) {
 		/* If anything isn't mapped */
 		if (!isMapped(to_unmap)) {
 			/* Return the error */
-			modifying_page_tables.release_lock();
+			modifying_page_tables.release_write();
 			return map_notmapped;
 		}
 	}
@@ -454,19 +553,49 @@ map_results unmap_range(void const *const virt_addr, size_t len,
 		if (attempt == pmm_invalid || attempt == pmm_null) {
 			/* Call it an invalid option because we shouldn't have been managing
 			 * it(TODO: better description) */
-			modifying_page_tables.release_lock();
+			modifying_page_tables.release_write();
 			return map_invalid_option;
 		}
 	}
 	/* Loop through again */
 	to_unmap = virt_addr;
 	size_t searchable_offset = searchable_page_table_offset(virt_addr);
-	for (size_t count = 0; count < bytes_to_pages(len); count++, to_unmap++) {
+	size_t num_pages = bytes_to_pages(len);
+	for (size_t count = 0; count < num_pages; count++, to_unmap++) {
 		/* Actually unmap it */
 		unmap_page(to_unmap, 0);
 		page_tables_searchable[searchable_offset + count] = false;
 	}
-	modifying_page_tables.release_lock();
+	if (cpus_online.load() > 1) {
+		/* Other CPUs might still be using it, so don't reuse it yet */
+		memset(&page_tables_searchable[searchable_offset], true,
+		       sizeof(*page_tables_searchable) * num_pages);
+		defer_unmap(searchable_offset, num_pages, shoot_down_tlbs());
+	}
+	modifying_page_tables.release_write();
+	return map_success;
+}
+
+map_results make_guard_page(void const *virt_addr, unsigned int opts) {
+	modifying_page_tables.acquire_write();
+	if (!isMapped(virt_addr)) {
+		modifying_page_tables.release_write();
+		return map_notmapped;
+	}
+	/* The page is normally part of a bigger PMM area, which can only be
+	 * freed whole */
+	if ((opts & PHYS_ADDR_AUTO) != 0) {
+		modifying_page_tables.release_write();
+		return map_invalid_option;
+	}
+	unmap_page(virt_addr, 0);
+	/* Still "in use" as far as find_free_virtmem is concerned */
+	page_tables_searchable[searchable_page_table_offset(virt_addr)] = true;
+	if (cpus_online.load() > 1) {
+		/* The address is never reused, so there's nothing to wait for */
+		shoot_down_tlbs();
+	}
+	modifying_page_tables.release_write();
 	return map_success;
 }
 
@@ -517,7 +646,7 @@ int setup_paging() {
 
 	/* Map the kernel and page directory */
 	/* This makes sure that they haven't been unmapped */
-	modifying_page_tables.acquire_lock();
+	modifying_page_tables.acquire_write();
 	for (page where = &kernel_start; where <= &kernel_end; ++where) {
 		page phys_where = where.getInt() - VA_OFFSET;
 		page_table_entry *cur_pte =
@@ -557,7 +686,7 @@ int setup_paging() {
 	 * paging */
 	assert(isMapped(&kernel_start));
 	assert(isMapped(&kernel_end));
-	modifying_page_tables.release_lock();
+	modifying_page_tables.release_write();
 	/* Writeback instead of writethrough (PWT==1<<3) */
 	/* cr3 |= (1<<3); */
 	/* Don't disable caching (PCD==1<<4) */
@@ -568,6 +697,18 @@ int setup_paging() {
 	return 0;
 }
 
+bool lookup_phys_addr(void const *virt_addr, PhysAddr<void const> *phys_addr) {
+	uint32_t flags = modifying_page_tables.acquire_read();
+	/* The page tables it would be in may not even exist if it isn't mapped */
+	bool result = isMapped(virt_addr);
+	if (result) {
+		*phys_addr = PhysAddr<void const>(virt_to_phys(virt_addr).as_int() +
+		                                  page_offset(virt_addr));
+	}
+	modifying_page_tables.release_read(flags);
+	return result;
+}
+
 /* Copied from https://wiki.osdev.org/Paging#INVLPG */
 void invlpg(page const addr) {
 	asm volatile("invlpg (%0)" ::"b"(addr.get()) : "memory");
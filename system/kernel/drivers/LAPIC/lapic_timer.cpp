@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <cstdint>
+#include <drivers/clocksource.h>
+#include <drivers/pit.h>
+#include <drivers/timer.h>
+#include <feline/settings.h>
+#include <kernel/arch/i386/apic.h>
+#include <kernel/asm_compat.h>
+#include <kernel/cpu.h>
+#include <kernel/irq.h>
+#include <kernel/scheduler.h>
+
+/* Use the local APIC timer if there is one, it's per-CPU and doesn't need any
+ * port I/O. Otherwise fall back to the PIT. The local APIC timer also needs the
+ * TSC, both to calibrate it and because it can't tell how much time has passed
+ * by itself. */
+void init_timers() {
+	Settings::Time::ns_since_boot.initialize(0);
+	if (!have_clocksource() || !init_apic()) {
+		pit_init_timers();
+		return;
+	}
+	calibrate_lapic_timer();
+	/* Tick every millisecond until the scheduler says otherwise */
+	lapic_timer_start(LapicTimerMode::periodic, 1'000'000);
+}
+
+void set_next_timer_event(uint64_t ns) {
+	if (!apic_enabled()) {
+		pit_set_next_timer_event(ns);
+		return;
+	}
+	lapic_timer_start(LapicTimerMode::one_shot, ns);
+}
+
+ASM void LAPIC_timer_isr_handler() {
+	/* It only has room for one writer */
+	if (cpu_id() == 0) {
+		Settings::Time::ns_since_boot.get().write(now_ns());
+	}
+	lapic_eoi();
+	scheduler_handle_tick();
+	irq_exit();
+}
@@ -1,40 +1,102 @@
-#include <drivers/timer.h>
+#include <cstdint>
+#include <drivers/pit.h>
 #include <feline/logger.h>
 #include <feline/settings.h>
-#include <kernel/arch/i386/idt.h>
+#include <feline/spinlock.h>
 #include <kernel/io.h>
+#include <kernel/irq.h>
 #include <kernel/scheduler.h>
 #include <kernel/vtopmem.h>
 
 // From https://wiki.osdev.org/PIT
 #define BASE_FREQ 1193182
+/* Channel 0 is wired to ISA IRQ 0 */
+#define PIT_IRQ 0
 
-// Make each tick be one millisecond (frequency 1KHz)
-#define TICKS_PER_SECOND 1'000
+/* The longest one-shot the 16 bit counter can do */
+#define MAX_COUNT 0xFFFF
 
-#define RELOAD_VALUE BASE_FREQ / TICKS_PER_SECOND
+/* PIT ticks counted so far, which ns_since_boot is worked out from so rounding
+ * errors don't add up */
+static uint64_t pit_ticks = 0;
+/* The count the running one-shot started from, or 0 if it has already fired */
+static uint16_t programmed_count = 0;
+static Spinlock pit_lock;
 
-void reload_pit() {
-	outb(0x40, RELOAD_VALUE & 0xFF);
+static void pit_irq_handler(void *);
+
+static uint64_t ticks_to_ns(uint64_t ticks) {
+	return ticks / BASE_FREQ * 1'000'000'000 +
+	       ticks % BASE_FREQ * 1'000'000'000 / BASE_FREQ;
+}
+
+static void update_ns_since_boot() {
+	Settings::Time::ns_since_boot.get().write(ticks_to_ns(pit_ticks));
+}
+
+/* Latch channel 0's status and count. Returns false if it already reached 0,
+ * and otherwise sets count to what's left. */
+static bool read_remaining(uint16_t *count) {
+	// Read-back command: latch status and count for channel 0
+	outb(0x43, 0b11'0'0'001'0);
+	uint8_t status = inb(0x40);
+	uint8_t low = inb(0x40);
+	uint8_t high = inb(0x40);
+	/* The output pin goes high on terminal count in mode 0 */
+	if ((status & 0x80) != 0) {
+		return false;
+	}
+	*count = static_cast<uint16_t>(low | (high << 8));
+	return true;
+}
+
+static void load_count(uint16_t count) {
+	/* Writing the count restarts the one-shot */
+	outb(0x40, count & 0xFF);
 	io_wait();
-	outb(0x40, (RELOAD_VALUE & 0xFF00) >> 8);
+	outb(0x40, (count & 0xFF00) >> 8);
+	programmed_count = count;
 }
 
-void init_timers() {
-	Settings::Time::ns_since_boot.initialize(0);
+void pit_set_next_timer_event(uint64_t ns) {
+	uint64_t count = ns * BASE_FREQ / 1'000'000'000;
+	if (ns > ticks_to_ns(MAX_COUNT)) {
+		count = MAX_COUNT;
+	} else if (count == 0) {
+		count = 1;
+	}
+	pit_lock.acquire_lock();
+	if (programmed_count != 0) {
+		uint16_t remaining;
+		if (!read_remaining(&remaining)) {
+			/* The interrupt is pending, and its handler sets the next one */
+			pit_lock.release_lock();
+			return;
+		}
+		/* Don't lose the time the old one-shot already counted */
+		pit_ticks += programmed_count - remaining;
+		update_ns_since_boot();
+	}
+	load_count(static_cast<uint16_t>(count));
+	pit_lock.release_lock();
+}
+
+void pit_init_timers() {
 	// Enable channel 0, both bytes readable, interrupt on terminal count,
 	// binary mode
-	outb(0x43, 0b00'11'011'0);
-	reload_pit();
-	IRQ_clear_mask(0);
+	outb(0x43, 0b00'11'000'0);
+	/* Tick every millisecond until the scheduler says otherwise */
+	pit_set_next_timer_event(1'000'000);
+	request_irq(PIT_IRQ, pit_irq_handler, nullptr);
 }
 
-ASM void PIT_isr_handler() {
-	/* Since we tick once a millisecond, add 1,000,000ns (=1ms) */
-	Settings::Time::ns_since_boot.get() += 1'000'000;
-
-	// Acknowledge the interrupt
-	outb(PIC1_COMMAND, PIC_EOI);
+static void pit_irq_handler(void *) {
+	pit_lock.acquire_lock();
+	/* The whole one-shot ran */
+	pit_ticks += programmed_count;
+	programmed_count = 0;
+	update_ns_since_boot();
+	pit_lock.release_lock();
 
 	scheduler_handle_tick();
 }
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <cpuid.h>
+#include <cstdint>
+#include <drivers/clocksource.h>
+#include <feline/logger.h>
+#include <feline/settings.h>
+#include <kernel/io.h>
+
+// From https://wiki.osdev.org/PIT
+#define PIT_FREQ 1193182
+
+/* How long to count TSC cycles for when calibrating, in PIT ticks (10ms) */
+#define CALIBRATION_TICKS (PIT_FREQ / 100)
+
+static bool have_tsc = false;
+static uint64_t tsc_at_boot = 0;
+/* ns per TSC cycle, as a 32.32 fixed point number */
+static uint64_t ns_per_cycle = 0;
+
+static uint64_t rdtsc() { return __builtin_ia32_rdtsc(); }
+
+/* cycles * ns_per_cycle, without overflowing for any realistic uptime */
+static uint64_t cycles_to_ns(uint64_t cycles) {
+	uint64_t high = cycles >> 32;
+	uint64_t low = cycles & 0xFFFF'FFFF;
+	return high * ns_per_cycle + low * (ns_per_cycle >> 32) +
+	       ((low * (ns_per_cycle & 0xFFFF'FFFF)) >> 32);
+}
+
+/* Count TSC cycles while PIT channel 2 (the speaker one, which nothing else
+ * uses) counts down, so channel 0 can keep running */
+static uint64_t measure_tsc_freq() {
+	uint8_t gate = inb(0x61);
+	// Gate channel 2 on, but keep the speaker off
+	outb(0x61, (gate & ~0x02) | 0x01);
+	// Channel 2, both bytes, interrupt on terminal count, binary mode
+	outb(0x43, 0b10'11'000'0);
+	outb(0x42, CALIBRATION_TICKS & 0xFF);
+	io_wait();
+	outb(0x42, (CALIBRATION_TICKS & 0xFF00) >> 8);
+	uint64_t start = rdtsc();
+	/* Channel 2's output goes high when it reaches 0 */
+	while ((inb(0x61) & 0x20) == 0) {
+	}
+	uint64_t end = rdtsc();
+	outb(0x61, gate);
+	return (end - start) * PIT_FREQ / CALIBRATION_TICKS;
+}
+
+void init_clocksource() {
+	unsigned int eax, ebx, ecx, edx;
+	/* EDX bit 4 is the TSC */
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (edx & (1 << 4)) == 0) {
+		kWarning() << "No TSC, time will only be as precise as the timer tick";
+		return;
+	}
+	/* Otherwise it changes speed with the CPU's frequency or stops when it
+	 * halts */
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+	    (edx & (1 << 8)) == 0) {
+		kWarning() << "The TSC isn't invariant, so time may drift";
+	}
+	uint64_t freq = measure_tsc_freq();
+	ns_per_cycle = (uint64_t{1'000'000'000} << 32) / freq;
+	tsc_at_boot = rdtsc();
+	have_tsc = true;
+	kLog() << "TSC runs at " << dec(freq / 1'000'000) << "MHz";
+}
+
+bool have_clocksource() { return have_tsc; }
+
+uint64_t now_ns() {
+	if (!have_tsc) {
+		/* Falls back to the timer tick. Locks can call this (to time
+		 * themselves) from early in boot, before init_timers sets it up. */
+		if (!Settings::Time::ns_since_boot) {
+			return 0;
+		}
+		return Settings::Time::ns_since_boot.get().read();
+	}
+	return cycles_to_ns(rdtsc() - tsc_at_boot);
+}
@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#ifndef KERNEL_CLOCKSOURCE_H
+#define KERNEL_CLOCKSOURCE_H
+
+#include <cstdint>
+
+/* Find out how fast the clock source runs. Call before init_timers. */
+void init_clocksource();
+/* Nanoseconds since (about) boot, with sub-microsecond resolution where the
+ * hardware has it. Doesn't lock anything, so it's fine to use from interrupt
+ * handlers. Returns 0 before init_clocksource. */
+uint64_t now_ns();
+/* Whether now_ns() reads a counter that runs by itself. If not, it only moves
+ * when the timer interrupt updates Settings::Time::ns_since_boot. */
+bool have_clocksource();
+
+#endif // KERNEL_CLOCKSOURCE_H
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#ifndef KERNEL_PIT_H
+#define KERNEL_PIT_H
+
+#include <cstdint>
+
+/* The PIT versions of init_timers and set_next_timer_event, for when there's no
+ * local APIC */
+void pit_init_timers();
+void pit_set_next_timer_event(uint64_t ns);
+
+#endif // KERNEL_PIT_H
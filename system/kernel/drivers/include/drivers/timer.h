@@ -4,6 +4,12 @@
 #ifndef KERNEL_TIMER_H
 #define KERNEL_TIMER_H
 
+#include <cstdint>
+
 void init_timers();
+/* Make the next timer interrupt come in about ns, replacing whatever was set
+ * before. Each interrupt only comes once, so the handler has to set the next
+ * one. ns is clamped to what the hardware can do, so it may come sooner. */
+void set_next_timer_event(uint64_t ns);
 
 #endif // KERNEL_TIMER_H
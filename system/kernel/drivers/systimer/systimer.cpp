@@ -1,9 +1,11 @@
 #include <cstdint>
+#include <drivers/clocksource.h>
 #include <drivers/timer.h>
 #include <feline/logger.h>
 #include <feline/settings.h>
 #include <kernel/interrupts.h>
 #include <kernel/io.h>
+#include <kernel/irq.h>
 #include <kernel/log.h>
 #include <kernel/mem.h>
 #include <kernel/scheduler.h>
@@ -22,36 +24,73 @@ struct SystemTimer {
 		timer_reg compare3;
 };
 
-static SystemTimer *timer;
+static SystemTimer *timer = nullptr;
 
-void reload_timer() {
-	/* Create an interrupt each microsecond (frequency 1MHz) */
-	timer->compare1 = timer->counter_low + 1'000'000;
+/* Compare register 1 matching. (0 and 2 are used by the GPU) */
+#define SYSTIMER_IRQ 1
+
+static void systimer_irq_handler(void *);
+
+/* The counter runs at 1MHz */
+constexpr uint64_t NS_PER_COUNT = 1'000;
+/* Any closer and the counter could pass the compare value before it's set,
+ * which would mean no interrupt until it comes round again */
+constexpr uint64_t MIN_EVENT_COUNTS = 10;
+/* Stay well within a lap of the 32 bit compare register */
+constexpr uint64_t MAX_EVENT_COUNTS = 0x8000'0000;
+
+void set_next_timer_event(uint64_t ns) {
+	uint64_t counts = ns / NS_PER_COUNT;
+	if (counts < MIN_EVENT_COUNTS) {
+		counts = MIN_EVENT_COUNTS;
+	} else if (counts > MAX_EVENT_COUNTS) {
+		counts = MAX_EVENT_COUNTS;
+	}
+	timer->compare1 = timer->counter_low + static_cast<uint32_t>(counts);
 }
 
-void init_timers() {
-	Settings::Time::ns_since_boot.initialize(0);
+/* The counter is also the clock source, since it starts at boot and never
+ * stops */
+void init_clocksource() {
 	/* Map the timer */
 	PhysAddr<SystemTimer> timer_addr(0x2000'3000);
+	SystemTimer *mapped;
 	auto result = map_range(timer_addr, sizeof(SystemTimer),
-	                        reinterpret_cast<void **>(&timer), MAP_DEVICE);
+	                        reinterpret_cast<void **>(&mapped), MAP_DEVICE);
 	if (result != map_success) {
 		kCritical() << "Unable to initialize timers!";
 		std::abort();
 	}
-	/* Enable the IRQ */
-	PhysAddr<uint32_t> ENABLE_IRQS_1(0x2000B210);
-	write_pmem<uint32_t>(ENABLE_IRQS_1, 0x2);
-	/* Start the timer */
-	reload_timer();
+	timer = mapped;
+}
+
+bool have_clocksource() { return timer != nullptr; }
+
+uint64_t now_ns() {
+	if (!timer) {
+		return 0;
+	}
+	/* The two halves can't be read at once, so retry if the low half wrapped
+	 * in between */
+	uint32_t high, low;
+	do {
+		high = timer->counter_high;
+		low = timer->counter_low;
+	} while (high != timer->counter_high);
+	return ((static_cast<uint64_t>(high) << 32) | low) * NS_PER_COUNT;
+}
+
+void init_timers() {
+	Settings::Time::ns_since_boot.initialize(0);
 	setup_irqs();
+	/* Tick every millisecond until the scheduler says otherwise */
+	set_next_timer_event(1'000'000);
+	request_irq(SYSTIMER_IRQ, systimer_irq_handler, nullptr);
 }
 
-void systimer_irq_handler() {
-	reload_timer();
-	Settings::Time::ns_since_boot.set(
-		((static_cast<uint64_t>(timer->counter_high) << 32) |
-	     timer->counter_low) *
-		1'000);
+static void systimer_irq_handler(void *) {
+	/* Acknowledge the compare1 match. The next one is set by the scheduler. */
+	timer->control_status = 1 << 1;
+	Settings::Time::ns_since_boot.get().write(now_ns());
 	scheduler_handle_tick();
 }
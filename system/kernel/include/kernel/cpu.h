@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef FELINE_CPU_H
+#define FELINE_CPU_H 1
+
+#include <atomic>
+#include <kernel/percpu.h>
+
+/* The most CPUs the kernel will use */
+#define MAX_CPUS 8
+
+/* How many CPUs are running (they are numbered 0 to cpus_online - 1) */
+inline std::atomic<unsigned> cpus_online{1};
+
+/* This CPU's number, set by init_percpu */
+extern PerCPU<unsigned> cpu_number;
+
+/* Which CPU this is running on */
+inline unsigned cpu_id() { return cpu_number.get(); }
+
+/* Start the other CPUs and have them join the scheduler. Call once, after
+ * init_timers. */
+void start_other_cpus();
+
+/* Interrupt cpu so it runs scheduler_handle_tick, for when its tick is stopped
+ * but it has something new to do */
+void kick_cpu(unsigned cpu);
+
+/* Tell the CPU we're busy-waiting, so it can save power or let the other
+ * hyper-thread run */
+inline void cpu_relax() {
+#ifdef __i386__
+	__asm__ volatile("pause" ::: "memory");
+#elifdef __arm__
+	__asm__ volatile("yield" ::: "memory");
+#endif
+}
+
+#endif /* FELINE_CPU_H */
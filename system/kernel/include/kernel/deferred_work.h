@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef _KERN_DEFERRED_WORK_H
+#define _KERN_DEFERRED_WORK_H 1
+
+#include <atomic>
+
+/* Something an interrupt handler wants done, but that is too slow to do with
+ * interrupts off, or needs to allocate or block. Embed it in whatever the work
+ * is for. */
+struct DeferredWork {
+		using Func = void (*)(DeferredWork *work);
+
+		constexpr explicit DeferredWork(Func func) : func(func) {}
+		DeferredWork(DeferredWork const &) = delete;
+		DeferredWork &operator=(DeferredWork const &) = delete;
+
+		Func func;
+		/* The next work in the same queue */
+		DeferredWork *next = nullptr;
+		/* From defer_work until just before func is called */
+		std::atomic<bool> queued{false};
+};
+
+/* Start this CPU's deferred work worker. Call after init_scheduler. */
+void init_deferred_work();
+/* Have this CPU's worker call work.func(&work), with interrupts enabled. Works
+ * are run in the order they were deferred, ahead of every task (even FIFO
+ * ones, which carry on afterwards) once the current interrupt exits. Does
+ * nothing if work is already queued, so a work deferred many times before it
+ * runs only runs once. */
+void defer_work(DeferredWork &work);
+
+#endif /* _KERN_DEFERRED_WORK_H */
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef _KERN_FPU_H
+#define _KERN_FPU_H 1
+
+#include <kernel/task.h>
+
+/* Each task has its own FPU/SSE (i386) or VFP (ARM) registers, switched
+ * lazily: the FPU is disabled whenever a task is switched to, and the first
+ * time the task uses it the trap loads its registers and enables it. Only tasks
+ * that used the FPU since they were switched to have it saved when they're
+ * switched away from. Interrupt handlers must not use the FPU. */
+
+/* Set the FPU up on this CPU, disabled. Call on every CPU, after
+ * init_scheduler. */
+void init_fpu();
+/* Called by switch_to, with interrupts disabled, before switching away from
+ * prev */
+void fpu_switch_out(Task *prev);
+/* Called by the arch's trap for using a disabled FPU: give it to the current
+ * task, with that task's registers loaded */
+void fpu_trap();
+
+/* Defined by each arch */
+/* Make the FPU usable on this CPU, but leave it disabled */
+void arch_init_fpu();
+void arch_enable_fpu();
+void arch_disable_fpu();
+/* Load the registers a task starts with */
+void arch_reset_fpu();
+void arch_save_fpu(FpuState *state);
+void arch_restore_fpu(FpuState const *state);
+
+#endif /* _KERN_FPU_H */
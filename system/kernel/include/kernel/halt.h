@@ -14,4 +14,33 @@
 	__builtin_unreachable();
 }
 
+/* For checking there's nothing to do before wait_for_interrupt, without an
+ * interrupt giving us something to do in between */
+inline void interrupts_off() {
+#ifdef __i386__
+	__asm__ volatile("cli" : : : "memory");
+#elifdef __arm__
+	__asm__ volatile("cpsid i" : : : "memory");
+#endif
+}
+
+inline void interrupts_on() {
+#ifdef __i386__
+	__asm__ volatile("sti" : : : "memory");
+#elifdef __arm__
+	__asm__ volatile("cpsie i" : : : "memory");
+#endif
+}
+
+/* Enable interrupts and sleep until one comes */
+inline void wait_for_interrupt() {
+#ifdef __i386__
+	/* sti only takes effect after the next instruction, so an interrupt can't
+	 * sneak in between them and leave hlt waiting for the next one */
+	__asm__ volatile("sti; hlt");
+#elifdef __arm__
+	__asm__ volatile("cpsie i; wfi");
+#endif
+}
+
 #endif /* FELINE_HALT_H */
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#ifndef KERNEL_HEAP_PROFILE_H
+#define KERNEL_HEAP_PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* An opt-in (build with HEAP_PROFILE=ON) profiler for the kernel heap. Every
+ * malloc is attributed to the call stack that made it, so that the call sites
+ * doing the most allocating can be found and fixed. */
+
+/* How many return addresses (after malloc's own) identify a call site */
+#define HEAP_PROFILE_DEPTH 4
+/* How many different call sites can be tracked. Allocations from any others
+ * are only counted as dropped. */
+#define HEAP_PROFILE_MAX_SITES 256
+/* The site returned when an allocation couldn't be attributed */
+#define HEAP_PROFILE_NO_SITE UINT16_MAX
+
+/* Records that len bytes were just allocated by the current call stack.
+ * Returns the site to pass to heap_profile_free when the memory is freed. */
+uint16_t heap_profile_alloc(size_t len);
+/* Records that len bytes allocated from site were freed */
+void heap_profile_free(uint16_t site, size_t len);
+
+/* Prints the top_n call sites by number of allocations and by bytes
+ * allocated */
+void heap_profile_report(size_t top_n = 10);
+
+#endif // KERNEL_HEAP_PROFILE_H
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef _KERN_IRQ_H
+#define _KERN_IRQ_H 1
+
+#include <cstdint>
+
+#if defined(__i386__)
+/* The ISA IRQs */
+#define NUM_IRQS 16
+#elif defined(__arm__)
+/* The BCM2835's 64 GPU IRQs, then its 8 ARM ones */
+#define NUM_IRQS 72
+#else
+#error "Unknown architecture! Can't figure out how many IRQs there are!"
+#endif
+
+/* How many handlers can share one line */
+#define MAX_IRQ_HANDLERS 4
+
+/* Called with interrupts disabled when its line interrupts, with the ctx it was
+ * requested with. On a shared line it has to check whether its device is the
+ * one interrupting. */
+using irq_handler = void (*)(void *ctx);
+
+/* Call handler(ctx) every time line interrupts, and unmask it. Handlers on a
+ * shared line are called in the order they were added. Returns false if the
+ * line doesn't exist or already has MAX_IRQ_HANDLERS. */
+bool request_irq(unsigned line, irq_handler handler, void *ctx);
+/* Stop calling handler(ctx) for line, masking it if nothing is left, and wait
+ * until no CPU is still in it. Not from a handler on the same line. */
+void free_irq(unsigned line, irq_handler handler, void *ctx);
+/* How many times line has interrupted, on every CPU */
+uint64_t irq_count(unsigned line);
+
+/* For the arch's interrupt handlers: call the handlers for line, or for every
+ * line set in pending (bit 0 being first_line), lowest first. Handlers must be
+ * short and not switch tasks; anything slow goes in a DeferredWork. */
+void dispatch_irq(unsigned line);
+void dispatch_irqs(uint32_t pending, unsigned first_line);
+/* The last thing every arch interrupt handler that can wake a task does, after
+ * the EOI: switches to the deferred work worker, or another task, if a handler
+ * asked for it */
+void irq_exit();
+
+/* Unmask or mask a line. Defined by each arch. */
+void arch_enable_irq(unsigned line);
+void arch_disable_irq(unsigned line);
+
+#endif /* _KERN_IRQ_H */
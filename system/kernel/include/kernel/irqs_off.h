@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#ifndef KERNEL_IRQS_OFF_H
+#define KERNEL_IRQS_OFF_H
+
+#include <cstdint>
+#include <feline/spinlock.h>
+
+/* An opt-in (build with IRQS_OFF_STATS=ON) tracker for how long locks keep
+ * interrupts disabled. Every lock counts its own sections (see IrqsOffStats),
+ * and any section of at least irqs_off_threshold_ns is logged along with the
+ * stack it was released from, to find what's hurting interrupt latency. */
+
+/* How many return addresses are logged for a long section */
+#define IRQS_OFF_STACK_DEPTH 6
+
+/* Starts at IRQS_OFF_THRESHOLD_NS (set by CMake), and can be changed at any
+ * time */
+extern uint64_t irqs_off_threshold_ns;
+
+/* Called by the locks, once the lock that was held for ns is released */
+void report_long_irqs_off(void const *lock, uint64_t ns);
+
+/* Where RWSpinlock's readers keep when this CPU's outermost one disabled
+ * interrupts, also for LATENCY_BENCH */
+uint64_t *this_cpu_read_irqs_off_since();
+
+/* Print one lock's stats */
+void report_irqs_off_stats(char const *name, IrqsOffStats const &stats);
+
+#endif // KERNEL_IRQS_OFF_H
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#ifndef KERNEL_LATENCY_BENCH_H
+#define KERNEL_LATENCY_BENCH_H
+
+#include <cstdint>
+
+/* An opt-in (build with LATENCY_BENCH=ON) benchmark of how quickly the kernel
+ * responds: how late timer interrupts and sleeping tasks wake up, what a task
+ * switch costs, and how long locks keep interrupts disabled. The hooks
+ * below record into per-CPU histograms from boot, and start_latency_bench
+ * adds its own measurements and prints them all over the log. */
+
+/* How many sleeps and sched() round trips the benchmark task times */
+#define LATENCY_BENCH_SLEEPS 500
+#define LATENCY_BENCH_ROUND_TRIPS 10'000
+
+/* From scheduler_handle_tick: the timer interrupted ns after it was set to */
+void latency_bench_timer_irq(uint64_t ns);
+/* From switch_to, just before and just after swap_task_registers */
+void latency_bench_switch_start();
+void latency_bench_switch_end();
+/* From the locks' release_lock: interrupts were disabled for ns */
+void latency_bench_irqs_off(uint64_t ns);
+
+/* Run the benchmark as a FIFO task on this CPU, and report when it's done */
+void start_latency_bench();
+
+#endif // KERNEL_LATENCY_BENCH_H
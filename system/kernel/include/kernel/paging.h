@@ -21,6 +21,18 @@ map_results map_range(uintptr_t len, void **virt_addr, size_t opts);
 /* Unmap all the pages from virt_addr to virt_addr+len */
 map_results unmap_range(void const *virt_addr, size_t len, unsigned int opts);
 
+/* Unmap the page containing virt_addr, but keep the address reserved so
+ * nothing else gets mapped there and touching it faults (the page tables still
+ * count it as mapped). Its physical page is left alone, to be freed along
+ * with the rest of its area, so PHYS_ADDR_AUTO isn't allowed. Free the
+ * address with unmap_range, without PHYS_ADDR_AUTO. */
+map_results make_guard_page(void const *virt_addr, unsigned int opts);
+
+/* Find the physical address virt_addr is mapped to, or return false if it
+ * isn't mapped. Only locks the page tables for reading, so it can run on
+ * several CPUs at once. */
+bool lookup_phys_addr(void const *virt_addr, PhysAddr<void const> *phys_addr);
+
 /* tells unmap_{page,range} to deallocate the memory from the pmm */
 /* TODO: get rid of this */
 #define PHYS_ADDR_AUTO 0b1u
@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef FELINE_PERCPU_H
+#define FELINE_PERCPU_H 1
+
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+/* Per-CPU variables are defined with PER_CPU, which puts the original in the
+ * .percpu section. init_percpu gives each CPU its own copy of the section, and
+ * points a register at how far that copy is from the original: GS's segment
+ * base on i386 (so reaching a variable is one instruction) and TPIDRPRW on
+ * ARM. Until then, every CPU uses the originals. */
+#define PER_CPU [[gnu::section(".percpu")]]
+
+/* Give this CPU its own copy of the per-CPU variables, with their initial
+ * values, and set cpu_id() to cpu. On i386, call after disable_gdt. */
+void init_percpu(unsigned cpu);
+/* Point this CPU at its copy. Defined by each arch. */
+void arch_set_percpu_offset(unsigned cpu, uintptr_t offset);
+
+/* This CPU's copy of the offset, which is 0 in the original */
+extern uintptr_t this_cpu_offset;
+/* Every CPU's offset, for getting at another CPU's copy */
+extern uintptr_t percpu_offsets[];
+
+/* How far this CPU's copies are from the originals. Interrupts must be
+ * disabled until you're done with the result, otherwise the task could move to
+ * another CPU. */
+inline uintptr_t percpu_offset() {
+	uintptr_t offset;
+#ifdef __i386__
+	__asm__ volatile("mov %%gs:%1, %0" : "=r"(offset) : "m"(this_cpu_offset));
+#elifdef __arm__
+	__asm__ volatile("mrc p15, 0, %0, c13, c0, 4" : "=r"(offset));
+#endif
+	return offset;
+}
+
+/* Whether PerCPU<T>::get and set work for T */
+template <typename T>
+constexpr bool fits_in_register =
+	std::is_trivially_copyable_v<T> &&
+	(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4);
+
+/* A variable every CPU has its own copy of. Only define these with PER_CPU. */
+template <typename T> class PerCPU {
+	public:
+		constexpr PerCPU() = default;
+		constexpr explicit PerCPU(T initial) : value(initial) {}
+		PerCPU(PerCPU const &) = delete;
+		PerCPU &operator=(PerCPU const &) = delete;
+
+		/* This CPU's copy. Interrupts must be disabled while using it. */
+		T *ptr() {
+			return reinterpret_cast<T *>(reinterpret_cast<uintptr_t>(&value) +
+			                             percpu_offset());
+		}
+		T &operator*() { return *ptr(); }
+		T *operator->() { return ptr(); }
+
+		/* Another CPU's copy, which is only safe if it isn't using it */
+		T &on(unsigned cpu) {
+			return *reinterpret_cast<T *>(
+				reinterpret_cast<uintptr_t>(&value) + percpu_offsets[cpu]);
+		}
+
+		/* Read or write this CPU's copy in one instruction (on i386), so it
+		 * doesn't matter if interrupts are enabled. The task can still move
+		 * to another CPU straight after. */
+		T get()
+			requires(fits_in_register<T>)
+		{
+#ifdef __i386__
+			uint_type raw;
+			__asm__ volatile("mov %%gs:%1, %0" : "=q"(raw) : "m"(value));
+			return std::bit_cast<T>(raw);
+#else
+			return *ptr();
+#endif
+		}
+		void set(T new_value)
+			requires(fits_in_register<T>)
+		{
+#ifdef __i386__
+			__asm__ volatile("mov %1, %%gs:%0"
+			                 : "=m"(value)
+			                 : "q"(std::bit_cast<uint_type>(new_value))
+			                 : "memory");
+#else
+			*ptr() = new_value;
+#endif
+		}
+
+	private:
+		/* An integer the same size as T, for get and set */
+		using uint_type = std::conditional_t<
+			sizeof(T) == 1, uint8_t,
+			std::conditional_t<sizeof(T) == 2, uint16_t, uint32_t>>;
+
+		T value{};
+};
+
+#endif /* FELINE_PERCPU_H */
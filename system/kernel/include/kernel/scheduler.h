@@ -6,18 +6,45 @@
 
 #include <kernel/task.h>
 
-/* Set-up the scheduler so it knows that we are the current task */
-void init_scheduler();
+/* Set-up the scheduler on this CPU so it knows that we are the current task.
+ * If we are running on a stack from create_new_stack, pass it so it's freed
+ * when we end. */
+void init_scheduler(TaskAllocation boot_stack = {});
 /* Switch to a different task, and return when the current task gets
  * re-scheduled */
 void sched();
-/* Create a new task that will run func, and make it schedule-able. */
-void add_new_task(init_task func);
-/* Switch to a different task and do not let this one be scheduled again. */
+/* Create a new task that will run func, and make it schedule-able. weight only
+ * matters for normal tasks: they get CPU time in proportion to it. */
+void add_new_task(init_task func, TaskPriority priority = TaskPriority::normal,
+                  uint32_t weight = DEFAULT_TASK_WEIGHT);
+/* Create a worker task (which runs ahead of FIFO tasks) that only ever runs on
+ * this CPU. It starts blocked, and runs each time wake_task is called on it. */
+Task *add_cpu_worker(init_task func);
+/* Don't run the current task again until now_ns() reaches ns. It may
+ * oversleep by up to a timer tick. */
+void sleep_until(uint64_t ns);
+/* Don't run the current task again for ns nanoseconds */
+void sleep_ns(uint64_t ns);
+/* The task that is running. Interrupts must be disabled (e.g. by holding a
+ * Spinlock), otherwise the task could move to another CPU halfway through. */
+Task *cur_task();
+/* Stop running the current task until wake_task is called on it. Set its state
+ * to blocked and make sure something will wake it first; if it was woken in
+ * between, this returns straight away. */
+void block_cur_task();
+/* Make a blocked task runnable again. Does nothing if it isn't blocked. */
+void wake_task(Task *task);
+/* Switch to a different task and do not let this one be scheduled again. Its
+ * resources are freed later by a low priority reaper task. */
 [[noreturn]] void end_cur_task();
-/* Release resources from terminated task. */
-void cleanup_finished_tasks();
-/* Stuff to do when a timer interrupt occurs */
+/* Stuff to do when a timer interrupt occurs. Switching tasks is left to
+ * scheduler_irq_exit. */
 void scheduler_handle_tick();
+/* Call sched() when this CPU is done handling the current interrupt, rather than
+ * in the middle of a handler */
+void resched_on_irq_exit();
+/* Called by irq_exit, with interrupts disabled: does the sched() asked for by
+ * resched_on_irq_exit, if there was one */
+void scheduler_irq_exit();
 
 #endif // _KERN_SCHEDULER_H
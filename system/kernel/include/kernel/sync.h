@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef FELINE_SYNC_H
+#define FELINE_SYNC_H 1
+
+#include <atomic>
+#include <cstddef>
+#include <feline/spinlock.h>
+#include <kernel/task.h>
+
+/* Blocking locks, for when the wait could be long enough that spinning with
+ * interrupts disabled would hold up everything else. They must only be used
+ * from tasks (not interrupt handlers), after init_scheduler. */
+
+/* Tasks waiting for something, woken in the order they started waiting */
+class WaitQueue {
+	public:
+		/* Release lock, sleep until woken, then re-acquire lock. Whatever
+		 * wakes us must hold lock too, so it can't be missed. */
+		void wait(Spinlock &lock);
+		/* Wake the task that has waited longest, and return false if there
+		 * wasn't one */
+		bool wake_one();
+		void wake_all();
+		bool empty() const { return head == nullptr; }
+
+	private:
+		Task *head = nullptr;
+		Task *tail = nullptr;
+};
+
+/* A lock that spins for a little while (on SMP) and then sleeps */
+class Mutex {
+	public:
+		void lock();
+		[[nodiscard("Did you mean lock?")]] bool try_lock();
+		void unlock();
+
+	private:
+		std::atomic<bool> locked = false;
+		/* Protects waiters, and makes unlock and going to sleep atomic */
+		Spinlock guard;
+		WaitQueue waiters;
+};
+
+/* A counting semaphore. up() can also be called from interrupt handlers. */
+class Semaphore {
+	public:
+		constexpr explicit Semaphore(size_t count = 0) : count(count) {}
+		/* Wait for the count to be non-zero, then decrement it */
+		void down();
+		[[nodiscard("Did you mean down?")]] bool try_down();
+		void up();
+
+	private:
+		size_t count;
+		Spinlock guard;
+		WaitQueue waiters;
+};
+
+/* Waits for a condition protected by a Mutex to change */
+class CondVar {
+	public:
+		/* Unlock mutex, sleep until notified, then lock mutex again. Wakeups
+		 * can be spurious, so check the condition in a loop. */
+		void wait(Mutex &mutex);
+		/* The mutex should be held while changing the condition, but needn't
+		 * be while notifying */
+		void notify_one();
+		void notify_all();
+
+	private:
+		Spinlock guard;
+		WaitQueue waiters;
+};
+
+#endif /* FELINE_SYNC_H */
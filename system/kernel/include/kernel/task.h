@@ -6,6 +6,7 @@
 
 #include <cstdint>
 #include <feline/kallocator.h>
+#include <feline/ktimer_wheel.h>
 #include <feline/kvector.h>
 #include <feline/logger.h>
 #include <kernel/asm_compat.h>
@@ -24,6 +25,10 @@ typedef __attribute__((noreturn)) void (*init_task)();
 
 enum task_state {
 	runnable,
+	/* Waiting for its wakeup timer, and not in any run queue */
+	sleeping,
+	/* Waiting in a WaitQueue, and not in any run queue */
+	blocked,
 	finished,
 };
 
@@ -50,6 +55,13 @@ struct x86Registers {
 
 typedef x86Registers Registers;
 
+/* Big enough for fxsave's image (fsave's is smaller). That has to be 16 byte
+ * aligned, which the heap doesn't promise, so there's room to align it. */
+struct x86FpuState {
+		uint8_t image[512 + 16];
+};
+typedef x86FpuState FpuState;
+
 #elif defined(__arm__)
 
 struct ARMGeneralRegisters {
@@ -73,6 +85,13 @@ struct ARMRegisters {
 		ARMGeneralRegisters general;
 };
 typedef ARMRegisters Registers;
+
+/* The ARM1176's VFP has 16 double registers */
+struct ARMFpuState {
+		uint64_t d[16];
+		uint32_t fpscr;
+};
+typedef ARMFpuState FpuState;
 #else
 #error "Unknown architecture! Can't figure how to layout process structures!"
 #endif
@@ -83,18 +102,74 @@ struct TaskAllocation {
 		size_t len;
 };
 
+enum class TaskPriority {
+	/* Per-CPU workers (see add_cpu_worker). Like fifo, but ahead of it. */
+	worker,
+	/* Runs before any other class except workers, and keeps running until it
+	 * calls sched() or ends (then the next FIFO task runs). If a worker
+	 * preempts it, it carries on once the worker is done. */
+	fifo,
+	/* Shares the CPU with the other normal tasks in proportion to weight */
+	normal,
+	/* Only runs when nothing else can */
+	idle,
+};
+
+/* Every task gets a stack this big */
+constexpr size_t TASK_STACK_SIZE = 16_KiB;
+/* How many freed stacks are kept around for new tasks */
+constexpr size_t STACK_CACHE_SIZE = 8;
+
+/* The weight of a normal task that isn't more or less important than others */
+constexpr uint32_t DEFAULT_TASK_WEIGHT = 1024;
+
+struct Task;
+/* Wakes a sleeping task up when it fires */
+struct TaskTimer : KTimerEntry {
+		Task *task;
+};
+
 struct Task {
 		Registers registers;
 		task_state state;
 		size_t num_times_scheduled;
-		KVector<TaskAllocation, KGeneralAllocator<TaskAllocation>> allocations;
+		TaskPriority priority = TaskPriority::normal;
+		uint32_t weight = DEFAULT_TASK_WEIGHT;
+		/* How many ns this task has run for, scaled by DEFAULT_TASK_WEIGHT /
+		 * weight. Normal tasks with the lowest vruntime run first. */
+		uint64_t vruntime;
+		/* When this task was last switched to (or charged for running) */
+		uint64_t run_start;
+		/* The next task in the same FIFO run queue */
+		Task *next_queued;
+		TaskTimer wakeup;
+		/* The CPU whose run queue it is in (or last ran on) */
+		unsigned cpu = 0;
+		/* Never stolen by another CPU, for per-CPU workers */
+		bool pinned = false;
+		/* Whether it has used the FPU, so fpu is worth loading */
+		bool fpu_used = false;
+		/* The CPU whose FPU it last used */
+		unsigned fpu_cpu = 0;
+		/* Its FPU registers, while they aren't loaded (see kernel/fpu.h) */
+		FpuState fpu;
+		/* Has a guard page below it */
+		TaskAllocation stack;
+		/* Anything else the task owns, freed when it finishes */
+		KSmallVector<TaskAllocation, 1> allocations;
 		// TODO: add threads
 };
 
 Task create_new_task(init_task start_executing);
 
-/* TODO: allocate guard pages, and place the stack where it can be expanded */
-TaskAllocation create_new_stack(size_t len = 16_KiB);
+/* Get a stack of TASK_STACK_SIZE with an unmapped guard page just below it, so
+ * overflowing it faults instead of silently corrupting whatever is next.
+ * Reuses a cached one if there are any, otherwise allocates it.
+ * TODO: place the stack where it can be expanded */
+TaskAllocation create_new_stack();
+/* Give back a stack from create_new_stack, keeping it for the next task if the
+ * cache isn't full. Safe to call with interrupts off. */
+void free_stack(TaskAllocation stack);
 
 /* Load the next process's and return to it. Will return from this function when
  * switching back to this process. This is a very low-level swap which only
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#include <feline/spinlock.h>
+#include <kernel/deferred_work.h>
+#include <kernel/percpu.h>
+#include <kernel/scheduler.h>
+#include <kernel/task.h>
+
+/* Work waiting for one CPU's worker, in the order it was deferred */
+struct DeferredQueue {
+		Spinlock lock;
+		DeferredWork *head = nullptr;
+		DeferredWork *tail = nullptr;
+		Task *worker = nullptr;
+};
+
+PER_CPU static PerCPU<DeferredQueue> deferred_queues;
+
+/* The body of each CPU's worker. It's pinned, so its queue never changes. */
+[[noreturn]] static void run_deferred_work() {
+	DeferredQueue &queue = *deferred_queues;
+	while (true) {
+		queue.lock.acquire_lock();
+		DeferredWork *work = queue.head;
+		if (!work) {
+			/* Holding the lock means defer_work can't have missed this */
+			queue.worker->state = blocked;
+			queue.lock.release_lock();
+			block_cur_task();
+			continue;
+		}
+		queue.head = work->next;
+		if (!queue.head) {
+			queue.tail = nullptr;
+		}
+		queue.lock.release_lock();
+		/* It can be deferred again while it runs, and then runs again after */
+		work->queued.store(false);
+		work->func(work);
+	}
+}
+
+void init_deferred_work() {
+	deferred_queues->worker = add_cpu_worker(run_deferred_work);
+}
+
+void defer_work(DeferredWork &work) {
+	if (work.queued.exchange(true)) {
+		return;
+	}
+	/* If we move CPU after this, the work still runs, just on the old one */
+	DeferredQueue &queue = *deferred_queues;
+	queue.lock.acquire_lock();
+	work.next = nullptr;
+	if (queue.tail) {
+		queue.tail->next = &work;
+	} else {
+		queue.head = &work;
+	}
+	queue.tail = &work;
+	queue.lock.release_lock();
+	wake_task(queue.worker);
+	resched_on_irq_exit();
+}
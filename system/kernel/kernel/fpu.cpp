@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#include <kernel/cpu.h>
+#include <kernel/fpu.h>
+#include <kernel/percpu.h>
+#include <kernel/scheduler.h>
+#include <kernel/task.h>
+
+/* The last task whose registers were loaded into this CPU's FPU. They're still
+ * there if nothing else has used it since, unless the task has used another
+ * CPU's FPU in between. Only compared, as it may have ended. */
+PER_CPU static PerCPU<Task *> fpu_owner;
+/* Whether the current task has enabled the FPU, so has to have it saved */
+PER_CPU static PerCPU<bool> fpu_enabled;
+
+void init_fpu() {
+	arch_init_fpu();
+	fpu_owner.set(nullptr);
+	fpu_enabled.set(false);
+}
+
+void fpu_switch_out(Task *prev) {
+	if (!fpu_enabled.get()) {
+		return;
+	}
+	arch_save_fpu(&prev->fpu);
+	arch_disable_fpu();
+	fpu_enabled.set(false);
+}
+
+void fpu_trap() {
+	Task *task = cur_task();
+	unsigned cpu = cpu_id();
+	arch_enable_fpu();
+	fpu_enabled.set(true);
+	if (!task->fpu_used) {
+		arch_reset_fpu();
+		task->fpu_used = true;
+	} else if (fpu_owner.get() != task || task->fpu_cpu != cpu) {
+		arch_restore_fpu(&task->fpu);
+	}
+	fpu_owner.set(task);
+	task->fpu_cpu = cpu;
+}
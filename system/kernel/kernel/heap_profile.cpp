@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <algorithm>
+#include <feline/logger.h>
+#include <feline/spinlock.h>
+#include <kernel/backtrace.h>
+#include <kernel/heap_profile.h>
+
+#ifdef HEAP_PROFILE
+
+struct HeapSite {
+		void *frames[HEAP_PROFILE_DEPTH];
+		bool used;
+		size_t count;
+		uint64_t bytes;
+		size_t live;
+		size_t peak;
+};
+
+/* malloc calls into here, so nothing in this file can allocate. */
+static HeapSite sites[HEAP_PROFILE_MAX_SITES];
+static size_t dropped;
+static Spinlock profile_lock;
+
+static size_t hash_frames(void *const frames[HEAP_PROFILE_DEPTH]) {
+	size_t hash = 0;
+	for (size_t i = 0; i < HEAP_PROFILE_DEPTH; ++i) {
+		hash = hash * 31 + (reinterpret_cast<uintptr_t>(frames[i]) >> 2);
+	}
+	return hash;
+}
+
+/* Finds (or claims) the site for frames with linear probing */
+static uint16_t find_site(void *const frames[HEAP_PROFILE_DEPTH]) {
+	size_t start = hash_frames(frames) % HEAP_PROFILE_MAX_SITES;
+	for (size_t i = 0; i < HEAP_PROFILE_MAX_SITES; ++i) {
+		size_t idx = (start + i) % HEAP_PROFILE_MAX_SITES;
+		HeapSite &site = sites[idx];
+		if (!site.used) {
+			site.used = true;
+			std::copy_n(frames, HEAP_PROFILE_DEPTH, site.frames);
+			return idx;
+		}
+		if (std::equal(frames, frames + HEAP_PROFILE_DEPTH, site.frames)) {
+			return idx;
+		}
+	}
+	return HEAP_PROFILE_NO_SITE;
+}
+
+uint16_t heap_profile_alloc(size_t len) {
+	/* The first frame is always in malloc */
+	void *stack[HEAP_PROFILE_DEPTH + 1] = {nullptr};
+	walk_stack(stack, HEAP_PROFILE_DEPTH + 1);
+
+	profile_lock.acquire_lock();
+	uint16_t idx = find_site(stack + 1);
+	if (idx == HEAP_PROFILE_NO_SITE) {
+		++dropped;
+	} else {
+		HeapSite &site = sites[idx];
+		site.count += 1;
+		site.bytes += len;
+		site.live += len;
+		site.peak = std::max(site.peak, site.live);
+	}
+	profile_lock.release_lock();
+	return idx;
+}
+
+void heap_profile_free(uint16_t site, size_t len) {
+	if (site == HEAP_PROFILE_NO_SITE) {
+		return;
+	}
+	profile_lock.acquire_lock();
+	sites[site].live -= len;
+	profile_lock.release_lock();
+}
+
+static void print_site(HeapSite const &site) {
+	kout out(log_level::log);
+	out << dec(site.count) << " allocations, " << dec(site.bytes)
+		<< " bytes (live " << dec(site.live) << ", peak " << dec(site.peak)
+		<< ") from";
+	for (void *frame : site.frames) {
+		if (frame) {
+			out << ' ' << ptr(frame);
+		}
+	}
+}
+
+void heap_profile_report(size_t top_n) {
+	/* Copy everything out so printing (which may allocate) doesn't hold the
+	 * lock or see the numbers change underneath it. */
+	static HeapSite snapshot[HEAP_PROFILE_MAX_SITES];
+	profile_lock.acquire_lock();
+	auto snapshot_end = std::copy_if(std::begin(sites), std::end(sites),
+	                                 snapshot,
+	                                 [](HeapSite const &s) { return s.used; });
+	size_t snapshot_dropped = dropped;
+	profile_lock.release_lock();
+
+	size_t shown = std::min<size_t>(top_n, snapshot_end - snapshot);
+	kLog() << "Heap profile: " << dec(snapshot_end - snapshot)
+		   << " call sites, " << dec(snapshot_dropped)
+		   << " allocations not attributed.";
+	kLog() << "To get function names run addr2line -Cpfe kernel $pointer";
+
+	std::sort(snapshot, snapshot_end, [](HeapSite const &a, HeapSite const &b) {
+		return a.count > b.count;
+	});
+	kLog() << "Top call sites by allocations:";
+	std::for_each(snapshot, snapshot + shown, print_site);
+
+	std::sort(snapshot, snapshot_end, [](HeapSite const &a, HeapSite const &b) {
+		return a.bytes > b.bytes;
+	});
+	kLog() << "Top call sites by bytes:";
+	std::for_each(snapshot, snapshot + shown, print_site);
+}
+
+#endif // HEAP_PROFILE
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <feline/logger.h>
+#include <feline/spinlock.h>
+#include <kernel/cpu.h>
+#include <kernel/irq.h>
+#include <kernel/percpu.h>
+#include <kernel/scheduler.h>
+
+/* A handler for a line. ctx is written before handler, so a handler that can be
+ * seen always has the right ctx. */
+struct IrqAction {
+		std::atomic<irq_handler> handler{nullptr};
+		void *ctx = nullptr;
+};
+
+struct IrqLine {
+		IrqAction actions[MAX_IRQ_HANDLERS];
+		/* How many CPUs are calling its handlers, for free_irq */
+		std::atomic<unsigned> running{0};
+		/* Whether anything has been requested, so it's unmasked */
+		bool enabled = false;
+};
+
+static IrqLine irq_lines[NUM_IRQS];
+/* Only for requesting and freeing, dispatching doesn't lock anything */
+static Spinlock irq_lock;
+/* Counted per CPU, so interrupting doesn't share a cache line */
+struct IrqCounts {
+		uint64_t counts[NUM_IRQS];
+};
+PER_CPU static PerCPU<IrqCounts> irq_counts;
+
+static bool has_handlers(IrqLine &irq) {
+	for (IrqAction &action : irq.actions) {
+		if (action.handler.load() != nullptr) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool request_irq(unsigned line, irq_handler handler, void *ctx) {
+	if (line >= NUM_IRQS || !handler) {
+		return false;
+	}
+	IrqLine &irq = irq_lines[line];
+	irq_lock.acquire_lock();
+	for (IrqAction &action : irq.actions) {
+		if (action.handler.load() == nullptr) {
+			action.ctx = ctx;
+			action.handler.store(handler);
+			if (!irq.enabled) {
+				irq.enabled = true;
+				arch_enable_irq(line);
+			}
+			irq_lock.release_lock();
+			return true;
+		}
+	}
+	irq_lock.release_lock();
+	kError() << "IRQ " << dec(line) << " already has "
+			 << dec(MAX_IRQ_HANDLERS) << " handlers";
+	return false;
+}
+
+void free_irq(unsigned line, irq_handler handler, void *ctx) {
+	if (line >= NUM_IRQS) {
+		return;
+	}
+	IrqLine &irq = irq_lines[line];
+	irq_lock.acquire_lock();
+	for (IrqAction &action : irq.actions) {
+		if (action.handler.load() == handler && action.ctx == ctx) {
+			action.handler.store(nullptr);
+			break;
+		}
+	}
+	if (!has_handlers(irq) && irq.enabled) {
+		irq.enabled = false;
+		arch_disable_irq(line);
+	}
+	irq_lock.release_lock();
+	/* Someone could have loaded the handler just before it was cleared */
+	while (irq.running.load() != 0) {
+		cpu_relax();
+	}
+}
+
+uint64_t irq_count(unsigned line) {
+	uint64_t total = 0;
+	for (unsigned cpu = 0; cpu < cpus_online.load(); ++cpu) {
+		total += irq_counts.on(cpu).counts[line];
+	}
+	return total;
+}
+
+void dispatch_irq(unsigned line) {
+	if (line >= NUM_IRQS) {
+		return;
+	}
+	irq_counts->counts[line] += 1;
+	IrqLine &irq = irq_lines[line];
+	irq.running.fetch_add(1);
+	bool any = false;
+	for (IrqAction &action : irq.actions) {
+		irq_handler handler = action.handler.load();
+		if (handler) {
+			any = true;
+			handler(action.ctx);
+		}
+	}
+	irq.running.fetch_sub(1);
+	if (!any) {
+		/* Nothing will acknowledge it, so it would just keep coming */
+		kCriticalNoAlloc() << "Unexpected IRQ " << dec(line) << ", masking it";
+		irq_lock.acquire_lock();
+		if (!has_handlers(irq)) {
+			irq.enabled = false;
+			arch_disable_irq(line);
+		}
+		irq_lock.release_lock();
+	}
+}
+
+void dispatch_irqs(uint32_t pending, unsigned first_line) {
+	while (pending != 0) {
+		unsigned bit = static_cast<unsigned>(std::countr_zero(pending));
+		pending &= pending - 1;
+		dispatch_irq(first_line + bit);
+	}
+}
+
+void irq_exit() { scheduler_irq_exit(); }
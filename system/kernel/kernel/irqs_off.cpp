@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <feline/logger.h>
+#include <kernel/backtrace.h>
+#include <kernel/irqs_off.h>
+#include <kernel/percpu.h>
+
+#ifdef TIME_IRQS_OFF
+/* Only touched with interrupts disabled, by the reader holding a read lock */
+PER_CPU static PerCPU<uint64_t> read_irqs_off_since;
+
+uint64_t *this_cpu_read_irqs_off_since() { return read_irqs_off_since.ptr(); }
+#endif // TIME_IRQS_OFF
+
+#ifdef IRQS_OFF_STATS
+
+uint64_t irqs_off_threshold_ns = IRQS_OFF_THRESHOLD_NS;
+
+void report_long_irqs_off(void const *lock, uint64_t ns) {
+	/* Interrupts are still off, so nothing here can allocate. Logging takes
+	 * locks of its own, but they find interrupts already disabled, so they
+	 * don't end up back here. */
+	void *stack[IRQS_OFF_STACK_DEPTH] = {nullptr};
+	walk_stack(stack, IRQS_OFF_STACK_DEPTH);
+	kout out = kWarningNoAlloc();
+	out << "Interrupts were disabled for " << dec(ns / 1'000)
+		<< "us by lock " << hex(reinterpret_cast<uintptr_t>(lock))
+		<< ", released from";
+	for (void *frame : stack) {
+		if (frame) {
+			out << ' ' << frame;
+		}
+	}
+}
+
+void report_irqs_off_stats(char const *name, IrqsOffStats const &stats) {
+	static char const *const bucket_names[IrqsOffStats::NUM_BUCKETS] = {
+		"<1us",    "<4us", "<16us", "<64us",
+		"<256us", "<1ms", "<4ms",  ">=4ms"};
+	uint64_t mean = stats.sections ? stats.total_ns / stats.sections : 0;
+	kout out(log_level::log);
+	out << name << ": " << dec(stats.sections) << " sections, mean "
+		<< dec(mean) << "ns, max " << dec(stats.max_ns) << "ns (";
+	for (size_t i = 0; i < IrqsOffStats::NUM_BUCKETS; ++i) {
+		out << (i == 0 ? "" : ", ") << bucket_names[i] << ' '
+			<< dec(stats.buckets[i]);
+	}
+	out << ')';
+}
+
+#endif // IRQS_OFF_STATS
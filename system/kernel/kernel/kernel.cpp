@@ -4,22 +4,32 @@
 #include <cinttypes>
 #include <drivers/framebuffer.h>
 #include <drivers/serial.h>
+#include <drivers/clocksource.h>
 #include <drivers/timer.h>
 #include <fcntl.h>
 #include <feline/kallocator.h>
 #include <feline/kvector.h>
 #include <feline/logger.h>
 #include <feline/settings.h>
+#include <feline/rwlock.h>
+#include <feline/spinlock.h>
 #include <feline/str.h>
 #include <feline/tests.h>
 #include <kernel/arch.h>
 #include <kernel/asm_compat.h>
 #include <kernel/backtrace.h>
+#include <kernel/cpu.h>
+#include <kernel/deferred_work.h>
+#include <kernel/fpu.h>
 #include <kernel/halt.h>
+#include <kernel/heap_profile.h>
+#include <kernel/irqs_off.h>
+#include <kernel/latency_bench.h>
 #include <kernel/log.h>
 #include <kernel/mem.h>
 #include <kernel/misc.h>
 #include <kernel/modules.h>
+#include <kernel/percpu.h>
 #include <kernel/scheduler.h>
 #include <sys/syscall.h>
 #include <unistd.h>
@@ -37,11 +47,52 @@ KVector<Module, KGeneralAllocator<Module>> modules;
 
 ASM void kernel_main();
 
+#ifdef LOCK_STATS
+static void report_lock_stats() {
+	extern KernelLock modifying_pmm;
+	extern RWSpinlock modifying_page_tables;
+	extern KernelLock allocation_lock;
+	struct {
+			char const *name;
+			LockStats stats;
+	} locks[] = {{"modifying_pmm", modifying_pmm.stats()},
+	             {"modifying_page_tables (writers)",
+	              modifying_page_tables.write_stats()},
+	             {"allocation_lock", allocation_lock.stats()}};
+	kLog() << "Lock stats:";
+	for (auto const &[name, stats] : locks) {
+		kLog() << name << ": " << dec(stats.acquisitions) << " acquisitions, "
+			   << dec(stats.contended) << " contended, " << dec(stats.spins)
+			   << " spins";
+	}
+}
+#endif // LOCK_STATS
+
+#ifdef IRQS_OFF_STATS
+static void report_irqs_off() {
+	extern KernelLock modifying_pmm;
+	extern RWSpinlock modifying_page_tables;
+	extern KernelLock allocation_lock;
+	kLog() << "Interrupts disabled by lock:";
+	report_irqs_off_stats("modifying_pmm", modifying_pmm.irqs_off_stats());
+	report_irqs_off_stats("modifying_page_tables (writers)",
+	                      modifying_page_tables.write_irqs_off_stats());
+	report_irqs_off_stats("modifying_page_tables (readers)",
+	                      modifying_page_tables.read_irqs_off_stats());
+	report_irqs_off_stats("allocation_lock", allocation_lock.irqs_off_stats());
+}
+#endif // IRQS_OFF_STATS
+
 void kernel_main() {
 	boot_setup();
 
+	init_percpu(0);
 	init_scheduler();
+	init_fpu();
+	init_deferred_work();
+	init_clocksource();
 	init_timers();
+	start_other_cpus();
 
 	if (Settings::Misc::commandline) {
 		kLog() << "Commandline: "
@@ -83,27 +134,43 @@ void kernel_main() {
 		end_cur_task();
 	});
 
-	add_new_task([]() __attribute__((noreturn)) {
-		kLog() << "Running tests:";
-		for (auto &test : test_functions) {
-			{
-				int result;
-				kout output(log_level::log);
-				output << test.name << "… ";
-				result = (test.func)();
-				if (result == 0) {
-					output << "ok!";
-				} else {
-					output << "error!";
-					kError() << "Test " << test.name << " failed with error "
-							 << dec(result);
-					break;
+#ifdef LATENCY_BENCH
+	start_latency_bench();
+#endif
+
+	/* The tests are batch work, so anything else should get ahead of them */
+	add_new_task(
+		[]() __attribute__((noreturn)) {
+			kLog() << "Running tests:";
+			for (auto &test : test_functions) {
+				{
+					int result;
+					kout output(log_level::log);
+					output << test.name << "… ";
+					result = (test.func)();
+					if (result == 0) {
+						output << "ok!";
+					} else {
+						output << "error!";
+						kError() << "Test " << test.name
+								 << " failed with error " << dec(result);
+						break;
+					}
 				}
+				sched();
 			}
-			sched();
-		}
-		end_cur_task();
-	});
+#ifdef HEAP_PROFILE
+			heap_profile_report();
+#endif
+#ifdef LOCK_STATS
+			report_lock_stats();
+#endif
+#ifdef IRQS_OFF_STATS
+			report_irqs_off();
+#endif
+			end_cur_task();
+		},
+		TaskPriority::normal, DEFAULT_TASK_WEIGHT / 4);
 
 	// halt();
 	end_cur_task();
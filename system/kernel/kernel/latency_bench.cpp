@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <atomic>
+#include <drivers/clocksource.h>
+#include <feline/khistogram.h>
+#include <feline/logger.h>
+#include <feline/spinlock.h>
+#include <kernel/cpu.h>
+#include <kernel/latency_bench.h>
+#include <kernel/percpu.h>
+#include <kernel/scheduler.h>
+
+#ifdef LATENCY_BENCH
+
+using LatencyHistogram = KHistogram<2>;
+
+/* Everything the hooks record, per CPU so they only need interrupts disabled
+ * (which they always are) and never share a cache line */
+struct LatencyStats {
+		LatencyHistogram timer_irq;
+		LatencyHistogram switches;
+		LatencyHistogram irqs_off;
+		/* When this CPU started its current switch_to */
+		uint64_t switch_started;
+};
+PER_CPU static PerCPU<LatencyStats> latency_stats;
+
+/* Only the benchmark task touches these */
+static LatencyHistogram sleep_lateness;
+static LatencyHistogram round_trips;
+static std::atomic<bool> round_trips_done;
+
+void latency_bench_timer_irq(uint64_t ns) { latency_stats->timer_irq.record(ns); }
+
+void latency_bench_switch_start() {
+	latency_stats->switch_started = now_ns();
+}
+
+void latency_bench_switch_end() {
+	LatencyStats &stats = *latency_stats;
+	stats.switches.record(now_ns() - stats.switch_started);
+}
+
+void latency_bench_irqs_off(uint64_t ns) { latency_stats->irqs_off.record(ns); }
+
+/* Sleep until a timer wheel tick (so nothing is lost to rounding) and see how
+ * late we wake up */
+static void time_sleeps() {
+	constexpr uint64_t MS = 1'000'000;
+	for (unsigned i = 0; i < LATENCY_BENCH_SLEEPS; ++i) {
+		uint64_t target = (now_ns() / MS + 1 + i % 4) * MS;
+		sleep_until(target);
+		sleep_lateness.record(now_ns() - target);
+	}
+}
+
+/* Bounce off a task on the same CPU: each round trip is two sched()s and two
+ * task switches */
+[[noreturn]] static void round_trip_partner() {
+	while (!round_trips_done.load()) {
+		sched();
+	}
+	end_cur_task();
+}
+
+static void time_round_trips() {
+	round_trips_done.store(false);
+	wake_task(add_cpu_worker(round_trip_partner));
+	for (unsigned i = 0; i < LATENCY_BENCH_ROUND_TRIPS; ++i) {
+		uint64_t start = now_ns();
+		sched();
+		round_trips.record(now_ns() - start);
+	}
+	round_trips_done.store(true);
+}
+
+static void report(char const *name, LatencyHistogram const &histogram) {
+	kLog() << name << ": " << dec(histogram.count()) << " samples, min "
+		   << dec(histogram.min()) << "ns, mean " << dec(histogram.mean())
+		   << "ns, p50 " << dec(histogram.percentile(50)) << "ns, p90 "
+		   << dec(histogram.percentile(90)) << "ns, p99 "
+		   << dec(histogram.percentile(99)) << "ns, max "
+		   << dec(histogram.max()) << "ns";
+	histogram.for_each_bucket([&](uint64_t low, uint64_t high, uint64_t count) {
+		kout out(log_level::log);
+		out << "  " << dec(low) << '-' << dec(high) << "ns: " << dec(count)
+			<< ' ';
+		/* A bar out of 50, but always at least one # */
+		uint64_t width = count * 50 / histogram.count();
+		for (uint64_t i = 0; i <= width; ++i) {
+			out << '#';
+		}
+	});
+}
+
+/* Add up every CPU's copy of one of the histograms */
+static void report_per_cpu(char const *name,
+                           LatencyHistogram LatencyStats::*member) {
+	/* Too big for the stack, and only the benchmark task uses it */
+	static LatencyHistogram total;
+	total.clear();
+	for (unsigned cpu = 0; cpu < cpus_online.load(); ++cpu) {
+		/* Other CPUs can be recording into it, so it may be slightly off */
+		total.merge(latency_stats.on(cpu).*member);
+	}
+	report(name, total);
+}
+
+[[noreturn]] static void run_latency_bench() {
+	kLog() << "Latency benchmark: timing " << dec(LATENCY_BENCH_SLEEPS)
+		   << " sleeps and " << dec(LATENCY_BENCH_ROUND_TRIPS)
+		   << " sched() round trips";
+	time_sleeps();
+	time_round_trips();
+	report("Sleep wakeup lateness", sleep_lateness);
+	report("sched() round trips", round_trips);
+	report_per_cpu("Timer interrupt lateness", &LatencyStats::timer_irq);
+	report_per_cpu("swap_task_registers", &LatencyStats::switches);
+	report_per_cpu("Interrupts disabled by a lock", &LatencyStats::irqs_off);
+	end_cur_task();
+}
+
+void start_latency_bench() { wake_task(add_cpu_worker(run_latency_bench)); }
+
+#endif // LATENCY_BENCH
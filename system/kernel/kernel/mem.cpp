@@ -87,9 +87,10 @@ mem_results get_mem(void **new_virt_addr, size_t len) {
 		kcritical("The memory manager has a bug!\n");
 		std::abort();
 	}
-	// Clear the memory
-	std::fill_n(static_cast<std::byte *>(*new_virt_addr), PHYS_MEM_CHUNK_SIZE,
-	            std::byte{0xCC});
+#if HEAP_POISON_LEVEL >= 1
+	// Poison the memory so uses of uninitialized memory stand out
+	std::fill_n(static_cast<std::byte *>(*new_virt_addr), len, std::byte{0xCC});
+#endif
 	return mem_success;
 }
 
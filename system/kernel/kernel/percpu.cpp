@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#include <cstdlib>
+#include <cstring>
+#include <feline/logger.h>
+#include <kernel/cpu.h>
+#include <kernel/mem.h>
+#include <kernel/percpu.h>
+
+/* Only take the address of these! They're from the linker script. */
+extern char __percpu_start;
+extern char __percpu_end;
+
+PER_CPU uintptr_t this_cpu_offset = 0;
+PER_CPU PerCPU<unsigned> cpu_number{0};
+uintptr_t percpu_offsets[MAX_CPUS] = {0};
+
+void init_percpu(unsigned cpu) {
+	/* Every CPU gets a copy, even CPU 0, so the originals keep their initial
+	 * values for later CPUs */
+	size_t len = static_cast<size_t>(&__percpu_end - &__percpu_start);
+	void *copy;
+	if (get_mem(&copy, len) != mem_success) {
+		kCritical() << "Unable to allocate CPU " << dec(cpu) << "'s data";
+		std::abort();
+	}
+	memcpy(copy, &__percpu_start, len);
+	uintptr_t offset = reinterpret_cast<uintptr_t>(copy) -
+	                   reinterpret_cast<uintptr_t>(&__percpu_start);
+	percpu_offsets[cpu] = offset;
+	/* Filled in before switching to it, in case an interrupt uses it */
+	*reinterpret_cast<uintptr_t *>(
+		reinterpret_cast<uintptr_t>(&this_cpu_offset) + offset) = offset;
+	cpu_number.on(cpu) = cpu;
+	arch_set_percpu_offset(cpu, offset);
+}
@@ -19,7 +19,7 @@
 #include <kernel/phys_mem.h>
 #include <kernel/vtopmem.h>
 
-Spinlock modifying_pmm;
+KernelLock modifying_pmm;
 
 /* Return the offset into a page */
 inline uintptr_t page_offset(uintptr_t const addr) {
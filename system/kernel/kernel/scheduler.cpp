@@ -2,142 +2,643 @@
 /* Copyright (c) 2024 James McNaughton Felder */
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <drivers/clocksource.h>
+#include <drivers/timer.h>
+#include <feline/kheap.h>
+#include <feline/kslab.h>
+#include <feline/ktimer_wheel.h>
 #include <feline/logger.h>
-#include <feline/settings.h>
 #include <feline/shortcuts.h>
 #include <feline/spinlock.h>
+#include <kernel/cpu.h>
+#include <kernel/deferred_work.h>
+#include <kernel/fpu.h>
 #include <kernel/halt.h>
+#include <kernel/latency_bench.h>
 #include <kernel/mem.h>
+#include <kernel/percpu.h>
 #include <kernel/scheduler.h>
 #include <kernel/task.h>
 
-/* TODO: add some acquire only if available so we don't hang on recursive
- * acquires. */
-Spinlock editing_task_list;
+/* Every Task lives here, so the scheduler only ever moves pointers around */
+static KSlab<Task> task_slab;
+static Spinlock task_slab_lock;
 
-/* TODO: make cpu-local */
-static Task current_task;
+/* How far apart timer wheel ticks are, which is how precisely sleeping tasks
+ * wake up */
+static constexpr uint64_t TIMER_WHEEL_TICK_NS = 1'000'000;
+/* How often a CPU with more than one task to run is interrupted to switch
+ * between them */
+static constexpr uint64_t PREEMPT_TICK_NS = 1'000'000;
 
-KVector<Task, KGeneralAllocator<Task>> all_tasks;
-
-/* Returns the next process to run, or nullptr if no other processes are
- * runnable. TODO: do this faster and support priorities. */
-decltype(all_tasks)::iterator find_next_task() {
-	Task *next_task = nullptr;
-	for (auto &p : all_tasks) {
-		if (p.state == runnable) {
-			if (!next_task ||
-			    next_task->num_times_scheduled > p.num_times_scheduled) {
-				next_task = &p;
+/* A run queue where tasks run in the order they were added, linked through
+ * Task::next_queued */
+class TaskFifo {
+	public:
+		bool empty() const { return head == nullptr; }
+		Task *front() const { return head; }
+		/* Queue task to run before every task already in the queue */
+		void push_front(Task *task) {
+			task->next_queued = head;
+			head = task;
+			if (!tail) {
+				tail = task;
+			}
+		}
+		void push(Task *task) {
+			task->next_queued = nullptr;
+			if (tail) {
+				tail->next_queued = task;
+			} else {
+				head = task;
+			}
+			tail = task;
+		}
+		Task *pop() {
+			Task *task = head;
+			head = task->next_queued;
+			if (!head) {
+				tail = nullptr;
 			}
+			return task;
+		}
+
+	private:
+		Task *head = nullptr;
+		Task *tail = nullptr;
+};
+
+/* Normal tasks that have had the least (weighted) time run first */
+struct VruntimeLess {
+		bool operator()(Task const *a, Task const *b) const {
+			return a->vruntime < b->vruntime;
+		}
+};
+
+/* Everything one CPU schedules. Only that CPU uses it, except for other CPUs
+ * stealing work, so the lock is almost never contended. */
+struct RunQueue {
+		/* Taken before switching tasks, and released by the task that gets
+		 * switched to */
+		Spinlock lock;
+		Task *current = nullptr;
+		/* Runs when there's nothing else to, and is never queued */
+		Task *idle_task = nullptr;
+		/* Every runnable task except the current one, by priority class */
+		TaskFifo workers;
+		TaskFifo fifo;
+		KMinHeap<Task *, VruntimeLess> normal;
+		TaskFifo idle;
+		/* How many tasks are in the queues above. Read without the lock when
+		 * looking for a queue to steal from. */
+		std::atomic<size_t> num_queued = 0;
+		/* The vruntime of the last normal task picked. It never goes backwards,
+		 * and new tasks start there so they can't take over the CPU until they
+		 * catch up. */
+		uint64_t min_vruntime = 0;
+		/* Tasks that have ended, waiting for the reaper. Linked through
+		 * next_queued, so ending a task never has to allocate. */
+		TaskFifo finished;
+		/* Frees finished tasks. It's an idle task so it never gets stolen,
+		 * and is blocked whenever there's nothing to free. */
+		Task *reaper = nullptr;
+		/* Wakeups for tasks that went to sleep on this CPU, in timer wheel
+		 * ticks */
+		KTimerWheel<> timers;
+		/* Set when there's at most one task to run, so the timer only
+		 * interrupts for the next wakeup instead of every PREEMPT_TICK_NS */
+		bool tick_stopped = false;
+		/* When the timer is set to interrupt next, in ns since boot */
+		uint64_t next_tick = 0;
+};
+
+static RunQueue run_queues[MAX_CPUS];
+
+static RunQueue &this_run_queue() { return run_queues[cpu_id()]; }
+
+/* Set by resched_on_irq_exit */
+PER_CPU static PerCPU<bool> resched_pending;
+
+/* Lock this CPU's run queue. The task can be preempted and moved to another CPU
+ * until the lock disables interrupts, so check it's still the right one. */
+static RunQueue &lock_this_run_queue() {
+	while (true) {
+		RunQueue &rq = this_run_queue();
+		rq.lock.acquire_lock();
+		if (&rq == &this_run_queue()) {
+			return rq;
+		}
+		rq.lock.release_lock();
+	}
+}
+
+/* Like lock_this_run_queue, but return nullptr if it's already locked */
+static RunQueue *try_lock_this_run_queue() {
+	while (true) {
+		RunQueue &rq = this_run_queue();
+		if (!rq.lock.try_acquire_lock()) {
+			return nullptr;
+		}
+		if (&rq == &this_run_queue()) {
+			return &rq;
+		}
+		rq.lock.release_lock();
+	}
+}
+
+static uint64_t scheduler_clock() { return now_ns(); }
+
+/* How many tasks want rq's CPU, including the current one */
+static size_t num_runnable(RunQueue &rq) {
+	bool current_runnable =
+		rq.current != rq.idle_task && rq.current->state == runnable;
+	return rq.num_queued.load(std::memory_order_relaxed) + current_runnable;
+}
+
+/* Set this CPU's timer to interrupt at ns (since boot). Must be called with
+ * rq's lock held. */
+static void set_next_tick(RunQueue &rq, uint64_t ns, uint64_t now) {
+	rq.next_tick = ns;
+	set_next_timer_event(ns > now ? ns - now : 0);
+}
+
+/* If rq's tick is stopped but a task was just added that needs to share the CPU
+ * (or another CPU is idle and needs to notice it), start it again. Must be
+ * called with rq's lock held. */
+static void restart_tick(RunQueue &rq) {
+	if (!rq.tick_stopped) {
+		return;
+	}
+	unsigned cpu = static_cast<unsigned>(&rq - run_queues);
+	if (cpu != cpu_id()) {
+		/* It sorts its tick out in scheduler_handle_tick */
+		if (num_runnable(rq) >= 1) {
+			kick_cpu(cpu);
+		}
+		return;
+	}
+	if (num_runnable(rq) < 2) {
+		return;
+	}
+	rq.tick_stopped = false;
+	uint64_t now = scheduler_clock();
+	set_next_tick(rq, now + PREEMPT_TICK_NS, now);
+}
+
+/* A preempted FIFO task goes back to the front of its queue, since it didn't
+ * give up the CPU */
+static void enqueue(RunQueue &rq, Task *task, bool preempted = false) {
+	switch (task->priority) {
+	case TaskPriority::worker:
+		rq.workers.push(task);
+		break;
+	case TaskPriority::fifo:
+		if (preempted) {
+			rq.fifo.push_front(task);
+		} else {
+			rq.fifo.push(task);
+		}
+		break;
+	case TaskPriority::normal:
+		rq.normal.push(task);
+		break;
+	case TaskPriority::idle:
+		rq.idle.push(task);
+		break;
+	}
+	rq.num_queued.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* Take the task that should run next out of rq, or return nullptr if it is
+ * empty */
+static Task *dequeue(RunQueue &rq) {
+	Task *task = nullptr;
+	if (!rq.workers.empty()) {
+		task = rq.workers.pop();
+	} else if (!rq.fifo.empty()) {
+		task = rq.fifo.pop();
+	} else if (!rq.normal.empty()) {
+		task = rq.normal.pop();
+		rq.min_vruntime = std::max(rq.min_vruntime, task->vruntime);
+	} else if (!rq.idle.empty()) {
+		task = rq.idle.pop();
+	} else {
+		return nullptr;
+	}
+	rq.num_queued.fetch_sub(1, std::memory_order_relaxed);
+	return task;
+}
+
+/* Take a FIFO or normal task from the CPU with the most queued tasks, or return
+ * nullptr if there isn't one (or its lock is busy). Must be called with rq's
+ * lock held. */
+static Task *steal(RunQueue &rq) {
+	RunQueue *busiest = nullptr;
+	size_t most_queued = 0;
+	for (unsigned cpu = 0; cpu < cpus_online.load(); ++cpu) {
+		size_t queued =
+			run_queues[cpu].num_queued.load(std::memory_order_relaxed);
+		if (&run_queues[cpu] != &rq && queued > most_queued) {
+			busiest = &run_queues[cpu];
+			most_queued = queued;
 		}
 	}
-	return next_task;
+	/* Don't wait for the lock: two CPUs stealing from each other would
+	 * deadlock, and it's fine to try again next tick */
+	if (!busiest || !busiest->lock.try_acquire_lock()) {
+		return nullptr;
+	}
+	/* Idle tasks can wait, there's nothing to gain by moving them. Pop from
+	 * the queue the task is in rather than with dequeue, which would take
+	 * busiest's (pinned) worker first if it has one queued. */
+	Task *task = nullptr;
+	if (!busiest->fifo.empty()) {
+		if (!busiest->fifo.front()->pinned) {
+			task = busiest->fifo.pop();
+		}
+	} else if (!busiest->normal.empty()) {
+		if (!busiest->normal.top()->pinned) {
+			task = busiest->normal.pop();
+			busiest->min_vruntime =
+				std::max(busiest->min_vruntime, task->vruntime);
+		}
+	}
+	if (task) {
+		busiest->num_queued.fetch_sub(1, std::memory_order_relaxed);
+		/* Its vruntime only means something relative to its old queue */
+		task->vruntime = rq.min_vruntime;
+	}
+	busiest->lock.release_lock();
+	return task;
 }
 
-void init_scheduler() {
-	current_task = create_new_task([]() __attribute__((noreturn)) {
+/* Like dequeue, but before settling for an idle task (or nothing) see if
+ * another CPU has more important work. If there's nothing at all, return rq's
+ * idle task. */
+static Task *pick_next(RunQueue &rq) {
+	if (rq.workers.empty() && rq.fifo.empty() && rq.normal.empty() &&
+	    cpus_online.load() > 1) {
+		if (Task *stolen = steal(rq)) {
+			return stolen;
+		}
+	}
+	Task *task = dequeue(rq);
+	return task ? task : rq.idle_task;
+}
+
+/* Charge the current task for the time since it was switched to */
+static void account_runtime(Task *task, uint64_t now) {
+	uint64_t ran = now - task->run_start;
+	task->vruntime += ran * DEFAULT_TASK_WEIGHT / task->weight;
+	task->run_start = now;
+}
+
+/* Make next the current task and switch to it. Must be called with rq's lock
+ * held, which is released by the next task. */
+static void switch_to(RunQueue &rq, Task *next, uint64_t now) {
+	Task *prev = rq.current;
+	rq.current = next;
+	next->cpu = cpu_id();
+	next->num_times_scheduled += 1;
+	next->run_start = now;
+	fpu_switch_out(prev);
+#ifdef LATENCY_BENCH
+	latency_bench_switch_start();
+#endif
+	swap_task_registers(&prev->registers, &next->registers);
+#ifdef LATENCY_BENCH
+	/* A new task starts in exit_scheduler_stub instead, and isn't counted */
+	latency_bench_switch_end();
+#endif
+}
+
+/* Make a blocked task in rq runnable again. Must be called with rq's lock
+ * held. */
+static void wake_locked(RunQueue &rq, Task *task) {
+	if (task->state == blocked) {
+		task->state = runnable;
+		/* If it's still current it hasn't switched away yet, and
+		 * block_cur_task will see it's runnable and carry on */
+		if (task != rq.current) {
+			task->vruntime = std::max(task->vruntime, rq.min_vruntime);
+			enqueue(rq, task);
+			restart_tick(rq);
+		}
+	}
+}
+
+static Task *new_task(init_task start_func) {
+	task_slab_lock.acquire_lock();
+	Task *task = task_slab.create(create_new_task(start_func));
+	task_slab_lock.release_lock();
+	return task;
+}
+
+/* Sleep until an interrupt, and then see if it made anything runnable */
+[[noreturn]] static void idle_loop() {
+	while (true) {
+		/* A task woken between checking and sleeping would wait for the
+		 * next interrupt, which a stopped tick may not send for a while. So
+		 * check with interrupts off, and wait_for_interrupt enables them
+		 * atomically with sleeping. */
+		interrupts_off();
+		if (this_run_queue().num_queued.load(std::memory_order_relaxed) == 0 &&
+		    !resched_pending.get()) {
+			wait_for_interrupt();
+		} else {
+			interrupts_on();
+		}
+		sched();
+	}
+}
+
+/* The body of each CPU's reaper task */
+[[noreturn]] static void reap_finished_tasks();
+
+void init_scheduler(TaskAllocation boot_stack) {
+	RunQueue &rq = this_run_queue();
+	rq.current = new_task([]() __attribute__((noreturn)) {
 		kCritical() << "Initial task re-scheduled without having called sched!";
 		halt();
 	});
+	if (boot_stack.addr) {
+		free_stack(rq.current->stack);
+		rq.current->stack = boot_stack;
+	}
+	/* It may first get switched to from an interrupt handler, so it can't rely
+	 * on interrupts being enabled */
+	rq.idle_task = new_task(idle_loop);
+	rq.idle_task->priority = TaskPriority::idle;
+	rq.reaper = new_task(reap_finished_tasks);
+	rq.reaper->priority = TaskPriority::idle;
+	/* Nothing to do until a task ends */
+	rq.reaper->state = blocked;
+	rq.current->cpu = rq.idle_task->cpu = rq.reaper->cpu = cpu_id();
 }
 
-void sched() {
+/* sched(), but preempted says whether the current task is being switched away
+ * from by an interrupt rather than giving up the CPU itself */
+static void reschedule(bool preempted) {
 	/* If the scheduler was running when this interrupted it, don't do anything
 	 * and just return so we can keep doing the task switch we were already
-	 * doing. TODO: spin if another processor has the lock, instead of it being
-	 * recursively taken. */
-	if (!editing_task_list.try_acquire_lock()) {
+	 * doing. */
+	RunQueue *locked = try_lock_this_run_queue();
+	if (!locked) {
 		return;
 	}
-	auto next_task = find_next_task();
-	if (!next_task) {
-		/* If there is no other task to run, keep running this one. */
-		editing_task_list.release_lock();
+	RunQueue &rq = *locked;
+	uint64_t now = scheduler_clock();
+	account_runtime(rq.current, now);
+	/* Put ourselves back first, so we keep running if we're still the best
+	 * choice, and go behind any other FIFO or idle tasks otherwise (unless
+	 * we're a preempted FIFO task). If we were preempted on the way to
+	 * block_cur_task, whoever wakes us puts us back. */
+	if (rq.current != rq.idle_task && rq.current->state == runnable) {
+		enqueue(rq, rq.current, preempted);
+	}
+	Task *next = pick_next(rq);
+	if (next == rq.current) {
+		rq.lock.release_lock();
 		return;
 	}
-	std::swap(current_task, *next_task);
-	current_task.num_times_scheduled += 1;
-	swap_task_registers(&next_task->registers, &current_task.registers);
+	switch_to(rq, next, now);
 	/* NOTE: we only returned here after being re-scheduled. This release the
 	 * lock taken by another task. The lock taken at the beginning of this
-	 * function was released by the next task that got scheduled. */
-	editing_task_list.release_lock();
+	 * function was released by the next task that got scheduled. We may have
+	 * been stolen by another CPU, so it's that CPU's lock. */
+	this_run_queue().lock.release_lock();
+}
+
+void sched() { reschedule(false); }
+
+void add_new_task(init_task start_func, TaskPriority priority,
+                  uint32_t weight) {
+	if (weight == 0) {
+		kCritical() << "Tasks can't have a weight of 0!";
+		std::abort();
+	}
+	Task *task = new_task(start_func);
+	task->priority = priority;
+	task->weight = weight;
+	/* Other CPUs steal it if they're less busy */
+	RunQueue &rq = lock_this_run_queue();
+	task->vruntime = rq.min_vruntime;
+	enqueue(rq, task);
+	restart_tick(rq);
+	rq.lock.release_lock();
+	/* An idle CPU won't look for it until its next wakeup, so tell one */
+	for (unsigned cpu = 0; cpu < cpus_online.load(); ++cpu) {
+		RunQueue &other = run_queues[cpu];
+		if (&other == &rq || !other.lock.try_acquire_lock()) {
+			continue;
+		}
+		bool idle = other.current == other.idle_task;
+		other.lock.release_lock();
+		if (idle) {
+			kick_cpu(cpu);
+			break;
+		}
+	}
 }
 
-void add_new_task(init_task start_func) {
-	editing_task_list.acquire_lock();
-	all_tasks.push_back(create_new_task(start_func));
-	editing_task_list.release_lock();
+Task *add_cpu_worker(init_task func) {
+	Task *task = new_task(func);
+	task->priority = TaskPriority::worker;
+	task->pinned = true;
+	task->state = blocked;
+	task->cpu = cpu_id();
+	return task;
+}
+
+void sleep_until(uint64_t ns) {
+	RunQueue &rq = lock_this_run_queue();
+	uint64_t now = scheduler_clock();
+	if (ns <= now) {
+		rq.lock.release_lock();
+		return;
+	}
+	Task *task = rq.current;
+	account_runtime(task, now);
+	task->state = sleeping;
+	task->wakeup.task = task;
+	/* Round up, so we never wake up early */
+	uint64_t wakeup_tick = (ns + TIMER_WHEEL_TICK_NS - 1) / TIMER_WHEEL_TICK_NS;
+	rq.timers.add(task->wakeup, wakeup_tick);
+	/* A stopped tick might not come round until after then */
+	if (rq.tick_stopped && wakeup_tick * TIMER_WHEEL_TICK_NS < rq.next_tick) {
+		set_next_tick(rq, wakeup_tick * TIMER_WHEEL_TICK_NS, now);
+	}
+	switch_to(rq, pick_next(rq), now);
+	/* Woken up by scheduler_handle_tick, see the note in sched() */
+	this_run_queue().lock.release_lock();
+}
+
+void sleep_ns(uint64_t ns) { sleep_until(scheduler_clock() + ns); }
+
+Task *cur_task() { return this_run_queue().current; }
+
+void block_cur_task() {
+	RunQueue &rq = lock_this_run_queue();
+	Task *task = rq.current;
+	if (task->state != blocked) {
+		/* Someone already woke us up */
+		rq.lock.release_lock();
+		return;
+	}
+	uint64_t now = scheduler_clock();
+	account_runtime(task, now);
+	switch_to(rq, pick_next(rq), now);
+	/* Woken up by wake_task, see the note in sched() */
+	this_run_queue().lock.release_lock();
+}
+
+void wake_task(Task *task) {
+	/* A blocked task isn't queued, so it can't be stolen and task->cpu can't
+	 * change under us */
+	RunQueue &rq = run_queues[task->cpu];
+	rq.lock.acquire_lock();
+	wake_locked(rq, task);
+	rq.lock.release_lock();
 }
 
 [[noreturn]] void end_cur_task() {
 	/* NOTE: this lock is released by whatever task we switch to, so it's
 	 * correct for it to look unlocked in this function. */
-	editing_task_list.acquire_lock();
-	auto next_task = find_next_task();
-	if (!next_task) {
-		/* TODO: support power-saving or something instead of running as an idle
-		 * task. */
-		kCritical() << "No more tasks to run, and current task ended. "
-					   "Waiting for next interrupt.";
-		editing_task_list.release_lock();
-		halt();
-	}
-	current_task.state = finished;
-	std::swap(current_task, *next_task);
-	current_task.num_times_scheduled += 1;
-	swap_task_registers(&next_task->registers, &current_task.registers);
+	RunQueue &rq = lock_this_run_queue();
+	rq.current->state = finished;
+	rq.finished.push(rq.current);
+	/* It can't free us until we've switched away and the lock is released.
+	 * Wake it before picking, so it can run next if nothing else will. */
+	wake_locked(rq, rq.reaper);
+	switch_to(rq, pick_next(rq), scheduler_clock());
 	/* Since our state is finished, we can never return from switch_process, but
 	 * the compiler doesn't know that */
 	__builtin_unreachable();
 }
 
-void cleanup_finished_tasks() {
-	/* Cleanup isn't (always) super important, so don't bother waiting if
-	 * someone else has the lock. */
-	if (!editing_task_list.try_acquire_lock()) {
-		return;
-	}
-	for (auto task = begin(all_tasks); task != end(all_tasks);) {
-		if (task->state == finished) {
+[[noreturn]] static void reap_finished_tasks() {
+	while (true) {
+		/* The reaper is never stolen, so this is always its own run queue */
+		RunQueue &rq = lock_this_run_queue();
+		if (rq.finished.empty()) {
+			rq.current->state = blocked;
+			rq.lock.release_lock();
+			block_cur_task();
+			continue;
+		}
+		/* Having the lock means every task in it has switched away for good,
+		 * so take them all and free them with the lock released */
+		TaskFifo dead = rq.finished;
+		rq.finished = TaskFifo{};
+		rq.lock.release_lock();
+		while (!dead.empty()) {
+			Task *task = dead.pop();
+			free_stack(task->stack);
 			for (auto &allocation : task->allocations) {
 				free_mem(allocation.addr, allocation.len);
 			}
-			all_tasks.erase(task);
-		} else {
-			++task;
+			task_slab_lock.acquire_lock();
+			task_slab.destroy(task);
+			task_slab_lock.release_lock();
 		}
 	}
-	editing_task_list.release_lock();
 }
 
 /* This is "called" by being returned to from swap_process_registers. */
 void exit_scheduler_stub(init_task start_executing) {
-	editing_task_list.release_lock();
+	this_run_queue().lock.release_lock();
 	start_executing();
 }
 
+/* Put every task whose wakeup time has passed back in the run queue */
+static void wake_sleeping_tasks() {
+	RunQueue &rq = this_run_queue();
+	/* Anything missed gets woken up on the next tick instead */
+	if (!rq.lock.try_acquire_lock()) {
+		return;
+	}
+	rq.timers.advance(scheduler_clock() / TIMER_WHEEL_TICK_NS,
+	                  [&rq](KTimerEntry &entry) {
+		Task *task = static_cast<TaskTimer &>(entry).task;
+		task->state = runnable;
+		/* Don't let it make up for all the time it was asleep */
+		task->vruntime = std::max(task->vruntime, rq.min_vruntime);
+		enqueue(rq, task);
+	});
+	rq.lock.release_lock();
+}
+
+/* Set when the timer should next interrupt: after PREEMPT_TICK_NS if there are
+ * tasks to switch between, otherwise not until something needs waking up */
+static void program_next_tick() {
+	RunQueue &rq = this_run_queue();
+	uint64_t now = scheduler_clock();
+	/* Whatever has the lock will be done long before the next tick, so just
+	 * keep ticking */
+	if (!rq.lock.try_acquire_lock()) {
+		set_next_timer_event(PREEMPT_TICK_NS);
+		return;
+	}
+	/* Switching tasks won't change how many there are, so this holds for
+	 * whichever one sched() picks */
+	rq.tick_stopped = num_runnable(rq) <= 1;
+	uint64_t next = now + PREEMPT_TICK_NS;
+	if (rq.tick_stopped) {
+		/* Still wake up for the message every second */
+		next = (now / 1'000'000'000 + 1) * 1'000'000'000;
+		if (!rq.timers.empty()) {
+			next = std::min(next, rq.timers.next_event() * TIMER_WHEEL_TICK_NS);
+		}
+	}
+	set_next_tick(rq, next, now);
+	rq.lock.release_lock();
+}
+
+/* Logging allocates, so it's done by the deferred work worker */
+static DeferredWork uptime_message([](DeferredWork *) {
+	kLog() << "It has been " << dec(scheduler_clock() / 1'000'000'000)
+		   << " seconds since boot.";
+});
+
 /* This happens every time a timer interrupt occurs. TODO: should it just be run
  * on every interrupt? */
 void scheduler_handle_tick() {
-	/* TODO: only do when computer is idle or low on resources? */
-	cleanup_finished_tasks();
+#ifdef LATENCY_BENCH
+	{
+		/* Only this CPU sets its next_tick. Kicks come before it's due. */
+		RunQueue &rq = this_run_queue();
+		uint64_t now = scheduler_clock();
+		if (rq.next_tick != 0 && now >= rq.next_tick) {
+			latency_bench_timer_irq(now - rq.next_tick);
+		}
+	}
+#endif
+	wake_sleeping_tasks();
+	program_next_tick();
 
 	/* If it is a new second, print the time */
 	static size_t second_since_boot = 0;
-	if (Settings::Time::ns_since_boot.get() / 1'000'000'000 >
-	    second_since_boot) {
-		add_new_task([]() __attribute__((noreturn)) {
-			kLog() << "It has been "
-				   << dec(Settings::Time::ns_since_boot.get() / 1'000'000'000)
-				   << " seconds since boot.";
-			end_cur_task();
-		});
-		second_since_boot = Settings::Time::ns_since_boot.get() / 1'000'000'000;
-	}
-
-	/* Run a different process (possibly) */
-	sched();
+	if (cpu_id() == 0 && scheduler_clock() / 1'000'000'000 > second_since_boot) {
+		defer_work(uptime_message);
+		second_since_boot = scheduler_clock() / 1'000'000'000;
+	}
+
+	/* Run a different process (possibly). FIFO tasks and workers aren't
+	 * preempted by the tick, they run until they call sched() or end. */
+	TaskPriority priority = this_run_queue().current->priority;
+	if (priority != TaskPriority::fifo && priority != TaskPriority::worker) {
+		resched_on_irq_exit();
+	}
+}
+
+void resched_on_irq_exit() { resched_pending.set(true); }
+
+void scheduler_irq_exit() {
+	if (resched_pending.get()) {
+		resched_pending.set(false);
+		reschedule(true);
+	}
 }
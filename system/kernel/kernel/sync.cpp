@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <kernel/cpu.h>
+#include <kernel/scheduler.h>
+#include <kernel/sync.h>
+
+/* How many times Mutex::lock tries again before going to sleep. Roughly a few
+ * microseconds, which is about as long as switching tasks away and back. */
+static constexpr size_t MUTEX_SPIN_LIMIT = 1000;
+
+void WaitQueue::wait(Spinlock &lock) {
+	/* Holding lock stops us moving CPU, so cur_task is safe */
+	Task *task = cur_task();
+	task->state = blocked;
+	/* A blocked task isn't in a run queue, so it can use next_queued */
+	task->next_queued = nullptr;
+	if (tail) {
+		tail->next_queued = task;
+	} else {
+		head = task;
+	}
+	tail = task;
+	lock.release_lock();
+	block_cur_task();
+	lock.acquire_lock();
+}
+
+bool WaitQueue::wake_one() {
+	Task *task = head;
+	if (!task) {
+		return false;
+	}
+	head = task->next_queued;
+	if (!head) {
+		tail = nullptr;
+	}
+	wake_task(task);
+	return true;
+}
+
+void WaitQueue::wake_all() {
+	while (wake_one()) {
+	}
+}
+
+bool Mutex::try_lock() {
+	return !locked.exchange(true, std::memory_order_acquire);
+}
+
+void Mutex::lock() {
+	if (try_lock()) {
+		return;
+	}
+	/* With one CPU the owner can't be running while we spin. With more, it is
+	 * probably about to unlock, and that's much cheaper than sleeping. */
+	if (cpus_online.load() > 1) {
+		for (size_t i = 0; i < MUTEX_SPIN_LIMIT; ++i) {
+			cpu_relax();
+			if (!locked.load(std::memory_order_relaxed) && try_lock()) {
+				return;
+			}
+		}
+	}
+	guard.acquire_lock();
+	while (!try_lock()) {
+		waiters.wait(guard);
+	}
+	guard.release_lock();
+}
+
+void Mutex::unlock() {
+	guard.acquire_lock();
+	locked.store(false, std::memory_order_release);
+	/* Whoever we wake still has to race for the lock, which is unfair but
+	 * stops a convoy forming behind a sleeping task */
+	waiters.wake_one();
+	guard.release_lock();
+}
+
+void Semaphore::down() {
+	guard.acquire_lock();
+	while (count == 0) {
+		waiters.wait(guard);
+	}
+	--count;
+	guard.release_lock();
+}
+
+bool Semaphore::try_down() {
+	guard.acquire_lock();
+	bool result = count != 0;
+	if (result) {
+		--count;
+	}
+	guard.release_lock();
+	return result;
+}
+
+void Semaphore::up() {
+	guard.acquire_lock();
+	++count;
+	waiters.wake_one();
+	guard.release_lock();
+}
+
+void CondVar::wait(Mutex &mutex) {
+	/* Start waiting before unlocking, so a notify right after can't be
+	 * missed */
+	guard.acquire_lock();
+	mutex.unlock();
+	waiters.wait(guard);
+	guard.release_lock();
+	mutex.lock();
+}
+
+void CondVar::notify_one() {
+	guard.acquire_lock();
+	waiters.wake_one();
+	guard.release_lock();
+}
+
+void CondVar::notify_all() {
+	guard.acquire_lock();
+	waiters.wake_all();
+	guard.release_lock();
+}
@@ -1,15 +1,54 @@
 /* SPDX-License-Identifier: MIT */
 /* Copyright (c) 2024 James McNaughton Felder */
 
+#include <cstddef>
+#include <feline/spinlock.h>
+#include <kernel/paging.h>
 #include <kernel/task.h>
 
-TaskAllocation create_new_stack(size_t len) {
-	void *stack;
-	if (get_mem(&stack, len) != mem_success) {
+/* Stacks that are ready to go, guard page and all. A fixed array so freeing
+ * never has to allocate. */
+static TaskAllocation stack_cache[STACK_CACHE_SIZE];
+static size_t num_cached_stacks = 0;
+static Spinlock stack_cache_lock;
+
+TaskAllocation create_new_stack() {
+	stack_cache_lock.acquire_lock();
+	if (num_cached_stacks > 0) {
+		TaskAllocation stack = stack_cache[--num_cached_stacks];
+		stack_cache_lock.release_lock();
+		return stack;
+	}
+	stack_cache_lock.release_lock();
+
+	void *guard;
+	if (get_mem(&guard, TASK_STACK_SIZE + PHYS_MEM_CHUNK_SIZE) != mem_success) {
 		kCriticalNoAlloc() << "Unable to allocate new stack!";
 		std::abort();
 	}
-	return TaskAllocation{.addr = stack, .len = len};
+	if (make_guard_page(guard, 0) != map_success) {
+		kCriticalNoAlloc() << "Unable to make a stack guard page!";
+		std::abort();
+	}
+	return TaskAllocation{.addr = static_cast<std::byte *>(guard) +
+	                              PHYS_MEM_CHUNK_SIZE,
+	                      .len = TASK_STACK_SIZE};
+}
+
+void free_stack(TaskAllocation stack) {
+	stack_cache_lock.acquire_lock();
+	if (num_cached_stacks < STACK_CACHE_SIZE) {
+		stack_cache[num_cached_stacks++] = stack;
+		stack_cache_lock.release_lock();
+		return;
+	}
+	stack_cache_lock.release_lock();
+
+	void *guard = static_cast<std::byte *>(stack.addr) - PHYS_MEM_CHUNK_SIZE;
+	unmap_range(guard, PHYS_MEM_CHUNK_SIZE, 0);
+	/* The guard page's physical memory is in the same PMM area as the stack,
+	 * so this frees it too */
+	free_mem(stack.addr, stack.len);
 }
 
 #ifdef __i386__
@@ -27,8 +66,7 @@ ASM reg get_eflags();
 Task create_new_task(init_task start_executing) {
 	auto task = Task{};
 	/* Allocate the stack, and create the topmost stack frame. */
-	auto stack = create_new_stack();
-	task.allocations.push_back(stack);
+	auto stack = task.stack = create_new_stack();
 	/* set-up the stack so exit_scheduler_stub calls start_executing when it
 	 * first gets scheduled */
 	task.registers.general.ebp =
@@ -42,8 +80,7 @@ Task create_new_task(init_task start_executing) {
 #else  // __i686__
 Task create_new_task(init_task start_executing) {
 	auto task = Task{};
-	auto stack = create_new_stack();
-	task.allocations.push_back(stack);
+	auto stack = task.stack = create_new_stack();
 	task.registers.general.r13 =
 		reinterpret_cast<uintptr_t>(stack.addr) + stack.len;
 	/* "return" to exit_scheduler_stub */
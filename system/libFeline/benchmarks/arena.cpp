@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+/* Compare a burst of small, short-lived vectors allocated with malloc/free
+ * against the same burst in a KArena that is reset afterwards. */
+
+#include <chrono>
+#include <cstdint>
+#include <feline/kallocator.h>
+#include <feline/karena.h>
+#include <feline/kvector.h>
+#include <iostream>
+
+constexpr size_t NUM_BURSTS = 10'000;
+constexpr size_t VECTORS_PER_BURST = 32;
+constexpr size_t ITEMS_PER_VECTOR = 20;
+
+template <typename Allocator> static void burst(Allocator const &allocator) {
+	KVector<uint32_t, Allocator> vectors[VECTORS_PER_BURST];
+	for (auto &vec : vectors) {
+		vec = KVector<uint32_t, Allocator>(allocator);
+		for (uint32_t i = 0; i < ITEMS_PER_VECTOR; ++i) {
+			vec.push_back(i);
+		}
+	}
+}
+
+static void report(char const *name, size_t allocations,
+                   std::chrono::steady_clock::duration elapsed) {
+	std::cout << name << '\t' << allocations << '\t'
+			  << std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+	                     .count() /
+	                 NUM_BURSTS
+			  << "ns\n";
+}
+
+int main() {
+	std::cout << "allocator\tget_memory calls\ttime/burst\n";
+
+	size_t allocations_before = get_memory_calls;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < NUM_BURSTS; ++i) {
+		burst(KGeneralAllocator<uint32_t>());
+	}
+	report("general", get_memory_calls - allocations_before,
+	       std::chrono::steady_clock::now() - start);
+
+	KArena arena;
+	allocations_before = get_memory_calls;
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < NUM_BURSTS; ++i) {
+		burst(KArenaAllocator<uint32_t>(arena));
+		arena.reset();
+	}
+	report("arena", get_memory_calls - allocations_before,
+	       std::chrono::steady_clock::now() - start);
+	return 0;
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+/* Compare how long it takes to build a KVector one push_back at a time with
+ * the exact and geometric growth policies. */
+
+#include <chrono>
+#include <cstdint>
+#include <feline/kallocator.h>
+#include <feline/kvector.h>
+#include <iostream>
+
+/* Count how many times each policy has to go back to the allocator */
+static size_t allocations;
+template <typename T> struct CountingAllocator : KGeneralAllocator<T> {
+		[[nodiscard]] T *allocate(std::size_t count) {
+			++allocations;
+			return KGeneralAllocator<T>::allocate(count);
+		}
+};
+
+template <typename Growth> void run(char const *name, size_t num_items) {
+	allocations = 0;
+	auto start = std::chrono::steady_clock::now();
+	{
+		KVector<uint32_t, CountingAllocator<uint32_t>, Growth> vec;
+		for (size_t i = 0; i < num_items; ++i) {
+			vec.push_back(static_cast<uint32_t>(i));
+		}
+	}
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start);
+	std::cout << name << '\t' << num_items << '\t' << allocations << '\t'
+			  << elapsed.count() << "us\n";
+}
+
+int main() {
+	std::cout << "policy\titems\tallocations\ttime\n";
+	for (size_t num_items : {10, 100, 1'000, 10'000, 50'000}) {
+		run<KExactGrowth>("exact", num_items);
+		run<KGeometricGrowth<>>("x1.5", num_items);
+		run<KGeometricGrowth<2, 1>>("x2", num_items);
+	}
+	return 0;
+}
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+/* Compare the three lock types with every hardware thread fighting over one
+ * lock to increment a counter, which also checks they actually exclude each
+ * other. Build with LOCK_STATS=ON to see how contended they were. Numbers are
+ * only meaningful with more than one CPU: with one, every handover waits for
+ * the holder to be scheduled again, which hurts the fair locks the most. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <feline/spinlock.h>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+constexpr size_t ACQUISITIONS_PER_THREAD = 100'000;
+
+template <typename Lock> static void report(char const *name, size_t threads) {
+	Lock lock;
+	size_t counter = 0;
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < threads; ++i) {
+		workers.emplace_back([&lock, &counter]() {
+			for (size_t j = 0; j < ACQUISITIONS_PER_THREAD; ++j) {
+				lock.acquire_lock();
+				counter += 1;
+				lock.release_lock();
+			}
+		});
+	}
+	for (auto &worker : workers) {
+		worker.join();
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	size_t total = threads * ACQUISITIONS_PER_THREAD;
+	LockStats stats = lock.stats();
+	std::cout << name << '\t' << threads << '\t'
+			  << std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+	                     .count() /
+	                 total
+			  << "ns\t" << stats.contended << '\t' << stats.spins
+			  << (counter == total ? "" : "\tLOST UPDATES") << '\n';
+}
+
+int main() {
+	size_t max_threads = std::max(2u, std::thread::hardware_concurrency());
+	std::cout << "lock\tthreads\ttime/acquire\tcontended\tspins\n";
+	for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+		report<Spinlock>("spinlock", threads);
+		report<TicketLock>("ticket", threads);
+		report<MCSLock>("mcs", threads);
+	}
+	return 0;
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+/* Count how many allocations formatting typical log lines makes */
+
+#include <chrono>
+#include <feline/kallocator.h>
+#include <feline/logger.h>
+#include <feline/settings.h>
+#include <feline/str.h>
+#include <iostream>
+
+/* Throw the output away, so only the formatting is measured */
+static void discard(char const *, size_t) {}
+
+int main() {
+	Settings::Logging::log.initialize(discard);
+	constexpr size_t NUM_LINES = 100'000;
+
+	size_t allocations_before = get_memory_calls;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < NUM_LINES; ++i) {
+		kLog() << "Reserved space for the PMM at " << hex(i * 4096) << " ("
+			   << dec(i) << " pages, " << dec(i % 7) << '/' << bin(i % 4)
+			   << ")";
+	}
+	auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start);
+	size_t allocations = get_memory_calls - allocations_before;
+
+	std::cout << "lines\tallocations/line\tns/line\n";
+	std::cout << NUM_LINES << '\t'
+			  << static_cast<double>(allocations) / NUM_LINES << '\t'
+			  << elapsed.count() / NUM_LINES << '\n';
+	return 0;
+}
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+/* Compare the cost of picking the next task by scanning every task for the
+ * least scheduled one (the old find_next_task) against popping it from a
+ * KMinHeap run queue, for different numbers of tasks. The heap is tried both
+ * holding whole tasks and holding pointers into a KSlab (what the scheduler
+ * does now), which doesn't depend on how big a task is. */
+
+#include <chrono>
+#include <cstdint>
+#include <feline/kallocator.h>
+#include <feline/kheap.h>
+#include <feline/kslab.h>
+#include <feline/kvector.h>
+#include <iostream>
+
+constexpr size_t NUM_SWITCHES = 100'000;
+
+/* Laid out like a kernel Task */
+struct FakeAllocation {
+		void *addr;
+		size_t len;
+};
+struct FakeTask {
+		uint32_t registers[9];
+		bool runnable;
+		size_t num_times_scheduled;
+		KSmallVector<FakeAllocation, 1> allocations;
+};
+
+struct ScheduledLess {
+		bool operator()(FakeTask const &a, FakeTask const &b) const {
+			return a.num_times_scheduled < b.num_times_scheduled;
+		}
+		bool operator()(FakeTask const *a, FakeTask const *b) const {
+			return a->num_times_scheduled < b->num_times_scheduled;
+		}
+};
+
+static size_t scan(size_t num_tasks) {
+	KVector<FakeTask, KGeneralAllocator<FakeTask>> all_tasks;
+	for (size_t i = 0; i < num_tasks; ++i) {
+		all_tasks.push_back(FakeTask{.runnable = true});
+	}
+	FakeTask current{.runnable = true};
+	for (size_t i = 0; i < NUM_SWITCHES; ++i) {
+		FakeTask *next = nullptr;
+		for (auto &task : all_tasks) {
+			if (task.runnable &&
+			    (!next || next->num_times_scheduled > task.num_times_scheduled)) {
+				next = &task;
+			}
+		}
+		std::swap(current, *next);
+		current.num_times_scheduled += 1;
+	}
+	return current.num_times_scheduled;
+}
+
+static size_t heap(size_t num_tasks) {
+	KMinHeap<FakeTask, ScheduledLess> run_queue;
+	for (size_t i = 0; i < num_tasks; ++i) {
+		run_queue.push(FakeTask{.runnable = true});
+	}
+	FakeTask current{.runnable = true};
+	for (size_t i = 0; i < NUM_SWITCHES; ++i) {
+		FakeTask next = run_queue.pop();
+		run_queue.push(std::move(current));
+		current = std::move(next);
+		current.num_times_scheduled += 1;
+	}
+	return current.num_times_scheduled;
+}
+
+static size_t slab_heap(size_t num_tasks) {
+	KSlab<FakeTask> slab;
+	KMinHeap<FakeTask *, ScheduledLess> run_queue;
+	for (size_t i = 0; i < num_tasks; ++i) {
+		run_queue.push(slab.create(FakeTask{.runnable = true}));
+	}
+	FakeTask *current = slab.create(FakeTask{.runnable = true});
+	for (size_t i = 0; i < NUM_SWITCHES; ++i) {
+		FakeTask *next = run_queue.pop();
+		run_queue.push(current);
+		current = next;
+		current->num_times_scheduled += 1;
+	}
+	size_t result = current->num_times_scheduled;
+	slab.destroy(current);
+	while (!run_queue.empty()) {
+		slab.destroy(run_queue.pop());
+	}
+	return result;
+}
+
+template <typename F> static void report(char const *name, size_t num_tasks, F f) {
+	auto start = std::chrono::steady_clock::now();
+	/* Use the result so the loop can't be optimized away */
+	volatile size_t result = f(num_tasks);
+	(void)result;
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << name << '\t' << num_tasks << '\t'
+			  << std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+	                     .count() /
+	                 NUM_SWITCHES
+			  << "ns\n";
+}
+
+int main() {
+	std::cout << "run queue\ttasks\ttime/switch\n";
+	for (size_t num_tasks : {10, 100, 1000}) {
+		report("scan", num_tasks, scan);
+		report("heap", num_tasks, heap);
+		report("slab heap", num_tasks, slab_heap);
+	}
+	return 0;
+}
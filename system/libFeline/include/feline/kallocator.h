@@ -11,6 +11,12 @@
 void *get_memory(size_t min_len);
 void return_memory(void *addr, size_t len);
 
+#ifdef LIBFELINE_ONLY
+/* How many times get_memory has been called, so hosted benchmarks can see how
+ * many allocations something makes. */
+extern size_t get_memory_calls;
+#endif
+
 template <typename T> struct KGeneralAllocator {
 		typedef T value_type;
 
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#ifndef _FELINE_KARENA_H
+#define _FELINE_KARENA_H 1
+
+#include <cstddef>
+#include <cstdlib>
+#include <feline/cpp_only.h>
+#include <feline/fixed_width.h>
+#include <limits>
+
+/* A bump allocator for bursts of allocations that all die together.
+ * Memory comes from large chunks (from get_memory), allocating is just moving
+ * a pointer forward, and everything is given back at once by reset() or the
+ * destructor. There is no locking, so only one task should use an arena. */
+class KArena {
+	public:
+		static constexpr size_t DEFAULT_CHUNK_SIZE = 16_KiB;
+
+		explicit KArena(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+		KArena(KArena const &) = delete;
+		KArena &operator=(KArena const &) = delete;
+		~KArena();
+
+		/* Get len bytes aligned to align (which must be a power of 2) */
+		[[nodiscard]] void *allocate(size_t len, size_t align);
+		/* Only the most recent allocation is actually given back (so a
+		 * growing KVector can reuse its space), everything else waits for
+		 * reset() */
+		void deallocate(void *addr, size_t len);
+		/* Free everything allocated from this arena. One chunk is kept so the
+		 * next burst doesn't have to go back to get_memory. */
+		void reset();
+
+	private:
+		struct Chunk {
+				Chunk *next;
+				size_t size;
+				size_t used;
+				std::byte *data() { return reinterpret_cast<std::byte *>(this + 1); }
+		};
+		/* Newest first, allocations only come from the first one */
+		Chunk *chunks;
+		size_t chunk_size;
+
+		Chunk *new_chunk(size_t min_size);
+};
+
+/* Lets containers (like KVector) allocate from a KArena */
+template <typename T> struct KArenaAllocator {
+		typedef T value_type;
+
+		KArenaAllocator() : arena(nullptr) {}
+		KArenaAllocator(KArena &arena) : arena(&arena) {}
+		template <typename U>
+		KArenaAllocator(KArenaAllocator<U> const &other) : arena(other.arena) {}
+
+		[[nodiscard]] T *allocate(std::size_t count) {
+			if (std::numeric_limits<size_t>::max() / sizeof(value_type) <
+			        count ||
+			    !arena) {
+				std::abort();
+			}
+			return static_cast<T *>(
+				arena->allocate(count * sizeof(value_type), alignof(value_type)));
+		}
+
+		void deallocate(T *addr, std::size_t count) {
+			if (addr) {
+				arena->deallocate(addr, count * sizeof(value_type));
+			}
+		}
+
+		KArena *arena;
+};
+
+#endif // _FELINE_KARENA_H
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#ifndef _FELINE_KHEAP_H
+#define _FELINE_KHEAP_H 1
+
+#include <cstddef>
+#include <feline/cpp_only.h>
+#include <feline/kallocator.h>
+#include <feline/kvector.h>
+#include <utility>
+
+/* A binary min-heap: top() is the element that Compare orders before every
+ * other element. push and pop are O(log n), top is O(1). */
+template <typename T, typename Compare,
+          typename Allocator = KGeneralAllocator<T>>
+class KMinHeap {
+	public:
+		using const_iterator = T const *;
+
+		constexpr KMinHeap() = default;
+		constexpr explicit KMinHeap(Compare compare) : compare(compare) {}
+
+		constexpr size_t size() const { return items.size(); }
+		constexpr bool empty() const { return items.size() == 0; }
+
+		constexpr T const &top() const { return items[0]; }
+
+		/* Add value, and return where it ended up. The reference is only valid
+		 * until the heap is next changed. */
+		T &push(T value) {
+			items.push_back(std::move(value));
+			return items[sift_up(items.size() - 1)];
+		}
+
+		/* Remove and return the top element */
+		T pop() {
+			T result = std::move(items[0]);
+			size_t last = items.size() - 1;
+			if (last != 0) {
+				items[0] = std::move(items[last]);
+			}
+			items.pop_back();
+			if (!empty()) {
+				sift_down(0);
+			}
+			return result;
+		}
+
+		constexpr void clear() { items.clear(); }
+
+		/* Elements are in heap order, not sorted order */
+		friend constexpr const_iterator begin(KMinHeap const &heap) {
+			return heap.items.data();
+		}
+		friend constexpr const_iterator end(KMinHeap const &heap) {
+			return heap.items.data() + heap.items.size();
+		}
+
+	private:
+		static constexpr size_t parent(size_t index) { return (index - 1) / 2; }
+		static constexpr size_t left(size_t index) { return index * 2 + 1; }
+
+		/* Move the element at index up until its parent is before it, and
+		 * return where it stopped */
+		size_t sift_up(size_t index) {
+			while (index != 0 && compare(items[index], items[parent(index)])) {
+				using std::swap;
+				swap(items[index], items[parent(index)]);
+				index = parent(index);
+			}
+			return index;
+		}
+
+		/* Move the element at index down until it is before its children */
+		void sift_down(size_t index) {
+			while (left(index) < items.size()) {
+				size_t child = left(index);
+				if (child + 1 < items.size() &&
+				    compare(items[child + 1], items[child])) {
+					child += 1;
+				}
+				if (!compare(items[child], items[index])) {
+					return;
+				}
+				using std::swap;
+				swap(items[index], items[child]);
+				index = child;
+			}
+		}
+
+		KVector<T, Allocator> items;
+		[[no_unique_address]] Compare compare;
+};
+
+#endif /* _FELINE_KHEAP_H */
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#ifndef _FELINE_KHISTOGRAM_H
+#define _FELINE_KHISTOGRAM_H 1
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <feline/cpp_only.h>
+
+/* Counts uint64_t samples (usually nanoseconds) in log-linear buckets: each
+ * power of two is split into 2^SubBucketBits equal buckets, so a bucket is
+ * never more than 1/2^SubBucketBits of its values wide. Recording is a few
+ * instructions and never allocates, so it's fine in interrupt handlers, but
+ * there's no locking. */
+template <size_t SubBucketBits = 2> class KHistogram {
+	public:
+		static constexpr size_t SUB_BUCKETS = size_t{1} << SubBucketBits;
+		static constexpr size_t NUM_BUCKETS =
+			(64 - SubBucketBits + 1) * SUB_BUCKETS;
+
+		constexpr void record(uint64_t value) {
+			buckets[bucket_index(value)] += 1;
+			if (samples == 0 || value < smallest) {
+				smallest = value;
+			}
+			largest = value > largest ? value : largest;
+			total += value;
+			samples += 1;
+		}
+
+		/* Add other's samples, e.g. to total up per-CPU histograms */
+		constexpr void merge(KHistogram const &other) {
+			if (other.samples == 0) {
+				return;
+			}
+			for (size_t index = 0; index < NUM_BUCKETS; ++index) {
+				buckets[index] += other.buckets[index];
+			}
+			if (samples == 0 || other.smallest < smallest) {
+				smallest = other.smallest;
+			}
+			largest = other.largest > largest ? other.largest : largest;
+			total += other.total;
+			samples += other.samples;
+		}
+
+		constexpr void clear() { *this = KHistogram(); }
+
+		constexpr uint64_t count() const { return samples; }
+		constexpr uint64_t min() const { return smallest; }
+		constexpr uint64_t max() const { return largest; }
+		constexpr uint64_t mean() const {
+			return samples == 0 ? 0 : total / samples;
+		}
+
+		/* The value that percent% of the samples are at or below, rounded up
+		 * to the top of its bucket (but never past max()). 0 if it's empty. */
+		constexpr uint64_t percentile(unsigned percent) const {
+			if (samples == 0) {
+				return 0;
+			}
+			/* Round up, so the 100th percentile is the last sample */
+			uint64_t wanted = (samples * percent + 99) / 100;
+			wanted = wanted == 0 ? 1 : wanted;
+			uint64_t seen = 0;
+			for (size_t index = 0; index < NUM_BUCKETS; ++index) {
+				seen += buckets[index];
+				if (seen >= wanted) {
+					uint64_t high = bucket_high(index);
+					return high < largest ? high : largest;
+				}
+			}
+			return largest;
+		}
+
+		/* Call f(low, high, count) for every non-empty bucket, lowest first.
+		 * Both ends are inclusive. */
+		template <typename F> constexpr void for_each_bucket(F &&f) const {
+			for (size_t index = 0; index < NUM_BUCKETS; ++index) {
+				if (buckets[index] != 0) {
+					f(bucket_low(index), bucket_high(index), buckets[index]);
+				}
+			}
+		}
+
+		static constexpr size_t bucket_index(uint64_t value) {
+			if (value < SUB_BUCKETS) {
+				return static_cast<size_t>(value);
+			}
+			/* Shift the top SubBucketBits + 1 bits down, then the leading 1
+			 * says which power of two it's in */
+			size_t shift = std::bit_width(value) - SubBucketBits - 1;
+			return (shift + 1) * SUB_BUCKETS +
+			       static_cast<size_t>((value >> shift) & (SUB_BUCKETS - 1));
+		}
+		static constexpr uint64_t bucket_low(size_t index) {
+			if (index < SUB_BUCKETS) {
+				return index;
+			}
+			size_t shift = index / SUB_BUCKETS - 1;
+			return (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+		}
+		static constexpr uint64_t bucket_high(size_t index) {
+			return index + 1 == NUM_BUCKETS ? UINT64_MAX
+			                                : bucket_low(index + 1) - 1;
+		}
+
+	private:
+		uint64_t buckets[NUM_BUCKETS] = {};
+		uint64_t samples = 0;
+		uint64_t smallest = 0;
+		uint64_t largest = 0;
+		uint64_t total = 0;
+};
+
+#endif /* _FELINE_KHISTOGRAM_H */
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#ifndef _FELINE_KSLAB_H
+#define _FELINE_KSLAB_H 1
+
+#include <cstddef>
+#include <feline/cpp_only.h>
+#include <feline/kallocator.h>
+#include <memory>
+#include <new>
+#include <utility>
+
+/* Allocates objects of one type from slabs of ObjectsPerSlab slots, so they
+ * never move and creating/destroying one is just taking/returning a slot on
+ * the free list. Slabs are only given back when the KSlab is destroyed, and
+ * there is no locking. */
+template <typename T, size_t ObjectsPerSlab = 32> class KSlab {
+	public:
+		constexpr KSlab() : slabs(nullptr), free_slots(nullptr) {}
+		KSlab(KSlab const &) = delete;
+		KSlab &operator=(KSlab const &) = delete;
+		/* Every object must have been destroyed first */
+		~KSlab() {
+			while (slabs) {
+				Slab *next = slabs->next;
+				return_memory(slabs, sizeof(Slab));
+				slabs = next;
+			}
+		}
+
+		template <typename... Args> [[nodiscard]] T *create(Args &&...args) {
+			if (!free_slots) {
+				add_slab();
+			}
+			Slot *slot = free_slots;
+			free_slots = slot->next_free;
+			return new (slot->storage) T(std::forward<Args>(args)...);
+		}
+
+		void destroy(T *object) {
+			std::destroy_at(object);
+			auto *slot = reinterpret_cast<Slot *>(object);
+			slot->next_free = free_slots;
+			free_slots = slot;
+		}
+
+	private:
+		union Slot {
+				Slot *next_free;
+				alignas(T) std::byte storage[sizeof(T)];
+		};
+		struct Slab {
+				Slab *next;
+				Slot slots[ObjectsPerSlab];
+		};
+		static_assert(alignof(Slab) <= alignof(std::max_align_t),
+		              "get_memory can't align slabs that much");
+
+		void add_slab() {
+			auto *slab = static_cast<Slab *>(get_memory(sizeof(Slab)));
+			slab->next = slabs;
+			slabs = slab;
+			for (Slot &slot : slab->slots) {
+				slot.next_free = free_slots;
+				free_slots = &slot;
+			}
+		}
+
+		Slab *slabs;
+		Slot *free_slots;
+};
+
+#endif /* _FELINE_KSLAB_H */
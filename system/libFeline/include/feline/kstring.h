@@ -11,7 +11,9 @@
 #include <feline/kallocator.h>
 #include <feline/kvector.h>
 
-using KString = KVector<char, KGeneralAllocator<char>>;
+/* Short strings (like any formatted 64-bit number) are stored inline, so most
+ * formatting never has to allocate */
+using KString = KSmallVector<char, 24>;
 using KConstString = KVector<char const, KGeneralAllocator<char>>;
 
 inline consteval KConstString operator""_kstr_vec(char const *characters,
@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#ifndef _FELINE_KTIMER_WHEEL_H
+#define _FELINE_KTIMER_WHEEL_H 1
+
+#include <cstddef>
+#include <cstdint>
+#include <feline/cpp_only.h>
+
+/* Something waiting in a KTimerWheel. Embed it in whatever needs to be woken
+ * up. */
+struct KTimerEntry {
+		/* The tick it fires on */
+		uint64_t expires = 0;
+		KTimerEntry *next = nullptr;
+		/* Whatever points at this entry (the previous entry's next, or the
+		 * slot), or nullptr if it isn't in a wheel */
+		KTimerEntry **pprev = nullptr;
+
+		constexpr bool queued() const { return pprev != nullptr; }
+};
+
+/* A hierarchical timer wheel: NumLevels levels of 2^LevelBits slots, where
+ * level L slots are 2^(L * LevelBits) ticks apart. Adding and removing are
+ * O(1), and each tick only looks at one slot, except when a level wraps and
+ * the next level's slot is spread back out over the lower ones. Entries too far
+ * in the future wait in the last level until they're close enough. */
+template <size_t LevelBits = 6, size_t NumLevels = 4> class KTimerWheel {
+	public:
+		static constexpr size_t SLOTS = size_t{1} << LevelBits;
+
+		constexpr explicit KTimerWheel(uint64_t now = 0)
+			: current(now), num_entries(0), slots{} {}
+		KTimerWheel(KTimerWheel const &) = delete;
+		KTimerWheel &operator=(KTimerWheel const &) = delete;
+
+		constexpr uint64_t now() const { return current; }
+		constexpr bool empty() const { return num_entries == 0; }
+
+		/* Fire entry when the wheel gets to expires, or on the next tick if it
+		 * already has */
+		void add(KTimerEntry &entry, uint64_t expires) {
+			entry.expires = expires;
+			/* The current tick's slot has already been handled */
+			insert(entry, current + 1);
+			++num_entries;
+		}
+
+		/* Stop entry from firing, if it hasn't already */
+		void remove(KTimerEntry &entry) {
+			if (!entry.queued()) {
+				return;
+			}
+			unlink(entry);
+			--num_entries;
+		}
+
+		/* The first tick after now() that advance would fire something on (or
+		 * spread entries out over the lower levels on), or UINT64_MAX if the
+		 * wheel is empty. Never later than the earliest entry, but it may be
+		 * earlier, so keep advancing to it until what you wanted fires. */
+		uint64_t next_event() const {
+			uint64_t next = UINT64_MAX;
+			if (empty()) {
+				return next;
+			}
+			/* Level 0 entries are all less than a lap away */
+			for (uint64_t tick = current + 1; tick < current + SLOTS; ++tick) {
+				if (slots[0][slot_index(tick, 0)]) {
+					next = tick;
+					break;
+				}
+			}
+			/* Higher levels only get looked at when their slot comes round */
+			for (size_t level = 1; level < NumLevels; ++level) {
+				uint64_t slot_ticks = level_range(level - 1);
+				uint64_t lap_start = current - current % level_range(level);
+				for (size_t index = 0; index < SLOTS; ++index) {
+					if (!slots[level][index]) {
+						continue;
+					}
+					uint64_t tick = lap_start + index * slot_ticks;
+					if (tick <= current) {
+						tick += level_range(level);
+					}
+					next = tick < next ? tick : next;
+				}
+			}
+			return next;
+		}
+
+		/* Move the wheel forward to now, calling expired(entry) for every entry
+		 * that fires. expired may add entries again. */
+		template <typename F> void advance(uint64_t now, F &&expired) {
+			while (current < now) {
+				if (empty()) {
+					/* Nothing to cascade or fire, so skip straight there */
+					current = now;
+					return;
+				}
+				++current;
+				cascade();
+				KTimerEntry *entry = take_slot(0, slot_index(current, 0));
+				while (entry) {
+					KTimerEntry *next = entry->next;
+					entry->pprev = nullptr;
+					--num_entries;
+					expired(*entry);
+					entry = next;
+				}
+			}
+		}
+
+	private:
+		static constexpr size_t slot_index(uint64_t tick, size_t level) {
+			return (tick >> (level * LevelBits)) & (SLOTS - 1);
+		}
+		/* How many ticks ahead entries in level can be */
+		static constexpr uint64_t level_range(size_t level) {
+			return uint64_t{1} << ((level + 1) * LevelBits);
+		}
+
+		/* Put entry in the slot for its expiry time, or earliest if that's
+		 * later */
+		void insert(KTimerEntry &entry, uint64_t earliest) {
+			uint64_t expires =
+				entry.expires > earliest ? entry.expires : earliest;
+			uint64_t delta = expires - current;
+			size_t level = 0;
+			while (level < NumLevels - 1 && delta >= level_range(level)) {
+				++level;
+			}
+			if (delta >= level_range(level)) {
+				/* Too far away for the wheel, so wait in the last slot of the
+				 * last level and get re-inserted when it comes round */
+				expires = current + level_range(level) - 1;
+			}
+			KTimerEntry *&head = slots[level][slot_index(expires, level)];
+			entry.next = head;
+			if (head) {
+				head->pprev = &entry.next;
+			}
+			head = &entry;
+			entry.pprev = &head;
+		}
+
+		void unlink(KTimerEntry &entry) {
+			*entry.pprev = entry.next;
+			if (entry.next) {
+				entry.next->pprev = entry.pprev;
+			}
+			entry.pprev = nullptr;
+		}
+
+		/* Detach and return the list of entries in a slot */
+		KTimerEntry *take_slot(size_t level, size_t index) {
+			KTimerEntry *entry = slots[level][index];
+			slots[level][index] = nullptr;
+			return entry;
+		}
+
+		/* When the lower levels have all wrapped around, the entries in the
+		 * next level's current slot are now close enough to go lower */
+		void cascade() {
+			size_t top = 0;
+			while (top + 1 < NumLevels &&
+			       slot_index(current, top) == 0) {
+				++top;
+			}
+			for (size_t level = top; level > 0; --level) {
+				KTimerEntry *entry = take_slot(level, slot_index(current, level));
+				while (entry) {
+					KTimerEntry *next = entry->next;
+					insert(*entry, current);
+					entry = next;
+				}
+			}
+		}
+
+		uint64_t current;
+		size_t num_entries;
+		KTimerEntry *slots[NumLevels][SLOTS];
+};
+
+#endif /* _FELINE_KTIMER_WHEEL_H */
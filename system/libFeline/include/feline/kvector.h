@@ -8,13 +8,57 @@
 #include <cstddef>
 #include <cstdlib>
 #include <feline/cpp_only.h>
+#include <feline/kallocator.h>
 #include <feline/shortcuts.h>
+#include <limits>
 #include <memory>
 #include <type_traits>
 
 void check_index(size_t index, size_t max);
 
-template <typename T, typename Allocator> class KVector {
+/* Growth policies decide how much capacity to allocate when a KVector runs out
+ * of room. Each one has a static next_capacity(current, needed) which must
+ * return at least needed. */
+
+/* Grow by Numerator/Denominator of the current capacity, so that N push_backs
+ * only cause O(log N) reallocations. The default of 3/2 (instead of 2) lets a
+ * first-fit malloc reuse the space freed by earlier, smaller buffers. */
+template <size_t Numerator = 3, size_t Denominator = 2> struct KGeometricGrowth {
+		static_assert(Numerator > Denominator,
+		              "KGeometricGrowth must actually grow the capacity!");
+		static constexpr size_t min_capacity = 4;
+		static constexpr size_t next_capacity(size_t current, size_t needed) {
+			/* Saturate instead of overflowing */
+			size_t grown = current > std::numeric_limits<size_t>::max() / Numerator
+			                   ? std::numeric_limits<size_t>::max()
+			                   : current * Numerator / Denominator;
+			/* Don't make lots of tiny allocations when starting out */
+			return std::max({grown, min_capacity, needed});
+		}
+};
+
+/* Only allocate exactly what is needed. Every growth reallocates, so only use
+ * this when memory matters more than time (or to compare against). */
+struct KExactGrowth {
+		static constexpr size_t next_capacity(size_t, size_t needed) {
+			return needed;
+		}
+};
+
+/* Space for N elements inside the KVector itself, so that small vectors never
+ * have to allocate. The elements are constructed and destroyed by the KVector.
+ */
+template <typename T, size_t N> struct KInlineStorage {
+		alignas(T) std::byte bytes[N * sizeof(T)];
+};
+template <typename T> struct KInlineStorage<T, 0> {};
+
+/* InlineCapacity elements are stored in the KVector itself, and the Allocator
+ * is only used once it grows past that. Prefer KSmallVector over setting it
+ * directly. */
+template <typename T, typename Allocator,
+          typename Growth = KGeometricGrowth<>, size_t InlineCapacity = 0>
+class KVector {
 	public:
 		using value_type = T;
 		using pointer = T *;
@@ -25,27 +69,32 @@ template <typename T, typename Allocator> class KVector {
 		using const_iterator = T const *;
 
 		constexpr KVector()
-			: items(nullptr), num_items(0), m_capacity(0), a() {}
+			: items(inline_data()), num_items(0),
+			  m_capacity(InlineCapacity), a() {}
+		/* Use a specific allocator (like a KArenaAllocator) */
+		constexpr explicit KVector(Allocator const &allocator)
+			: items(inline_data()), num_items(0),
+			  m_capacity(InlineCapacity), a(allocator) {}
 		constexpr KVector(pointer items, size_t size)
 			: items(items), num_items(size), m_capacity(size), a() {}
 		constexpr KVector(pointer items, size_t size)
 			requires(!std::is_const_v<value_type>)
-			: a() {
-			this->items = a.allocate(size);
-			this->num_items = size;
-			this->m_capacity = size;
+			: KVector() {
+			reserve(size);
 			std::uninitialized_copy_n(items, size, this->items);
+			this->num_items = size;
 		}
-		constexpr KVector(KVector &&other) : KVector() { swap(*this, other); }
+		constexpr KVector(KVector &&other) : KVector() { take(other); }
 		constexpr KVector(KVector const &other)
 			requires(std::is_const_v<value_type>)
 			: items(other.items()), num_items(other.size()),
 			  m_capacity(other.size()), a() {}
 		constexpr KVector(KVector const &other)
 			requires(!std::is_const_v<value_type>)
-			: num_items(other.size()), m_capacity(other.size()), a() {
-			this->items = a.allocate(m_capacity);
+			: KVector(other.a) {
+			reserve(other.size());
 			std::uninitialized_copy(begin(other), end(other), items);
+			num_items = other.size();
 		}
 
 		constexpr ~KVector()
@@ -55,11 +104,19 @@ template <typename T, typename Allocator> class KVector {
 			requires(!std::is_const_v<value_type>)
 		{
 			std::destroy_n(items, num_items);
-			a.deallocate(items, m_capacity);
+			if (!is_inline()) {
+				a.deallocate(items, m_capacity);
+			}
 		}
 
 		constexpr KVector &operator=(KVector &&other) {
-			swap(*this, other);
+			if constexpr (InlineCapacity == 0) {
+				swap(*this, other);
+			} else if (this != &other) {
+				clear();
+				release();
+				take(other);
+			}
 			return *this;
 		}
 
@@ -98,19 +155,38 @@ template <typename T, typename Allocator> class KVector {
 			auto new_items = a.allocate(num);
 			std::uninitialized_move(begin(*this), end(*this), new_items);
 			std::destroy_n(items, num_items);
-			a.deallocate(items, m_capacity);
+			release();
 			m_capacity = num;
 			items = new_items;
 		}
 
+		/* Release any capacity beyond what is currently being used, moving back
+		 * into the inline storage if everything fits */
+		void shrink_to_fit() {
+			if (is_inline() || num_items == m_capacity) {
+				return;
+			}
+			pointer new_items = inline_data();
+			size_t new_capacity = InlineCapacity;
+			if (num_items > InlineCapacity) {
+				new_items = a.allocate(num_items);
+				new_capacity = num_items;
+			}
+			std::uninitialized_move(begin(*this), end(*this), new_items);
+			std::destroy_n(items, num_items);
+			release();
+			m_capacity = new_capacity;
+			items = new_items;
+		}
+
 		void push_back(value_type item) {
-			reserve(num_items+1);
+			grow_for(1);
 			new(&items[num_items]) value_type(std::move(item));
 			num_items += 1;
 		}
 
 		void append(value_type item, size_t count = 1) {
-			reserve(num_items + count);
+			grow_for(count);
 			for (size_t i = 0; i < count; ++i) {
 				new (&items[num_items + i]) value_type(std::move(item));
 			}
@@ -122,12 +198,10 @@ template <typename T, typename Allocator> class KVector {
 		void append(const_pointer other, size_t len) {
 			append(KVector<value_type const, Allocator>(other, len));
 		}
-		void append(KVector<value_type, Allocator> other)
+		void append(KVector other)
 			requires(!std::is_const_v<value_type>)
 		{
-			if (m_capacity < (num_items + other.size()) || !items) {
-				reserve(num_items + other.size());
-			}
+			grow_for(other.size());
 			std::uninitialized_copy(begin(other), end(other),
 			                        &items[num_items]);
 			num_items += other.size();
@@ -135,14 +209,14 @@ template <typename T, typename Allocator> class KVector {
 		void append(KVector<value_type const, Allocator> other)
 			requires(std::is_same_v<std::remove_const_t<value_type>, value_type>)
 		{
-			reserve(num_items + other.size());
+			grow_for(other.size());
 			std::uninitialized_copy(begin(other), end(other),
 			                        &items[num_items]);
 			num_items += other.size();
 		}
 
 		void append(const_iterator first, const_iterator last) {
-			reserve(num_items + std::distance(first, last));
+			grow_for(std::distance(first, last));
 			std::uninitialized_copy(first, last, &items[num_items]);
 			num_items += std::distance(first, last);
 		}
@@ -150,7 +224,7 @@ template <typename T, typename Allocator> class KVector {
 		template <size_t N> void operator+=(value_type (&other)[N]) {
 			return append(other);
 		}
-		void operator+=(KVector<value_type, Allocator> other)
+		void operator+=(KVector other)
 			requires(!std::is_const_v<value_type>)
 		{ return append(other); }
 		void operator+=(KVector<T const, Allocator> other)
@@ -159,6 +233,12 @@ template <typename T, typename Allocator> class KVector {
 			return append(other);
 		}
 
+		constexpr void pop_back() {
+			check_index(0, num_items);
+			std::destroy_at(&items[num_items - 1]);
+			--num_items;
+		}
+
 		constexpr iterator erase(iterator pos) {
 			if (pos == end(*this)) {
 				return pos;
@@ -183,6 +263,14 @@ template <typename T, typename Allocator> class KVector {
 			num_items = 0;
 		}
 		friend void swap(KVector &first, KVector &second) {
+			/* Inline elements live inside the KVector, so they have to be
+			 * moved instead of just swapping pointers */
+			if (first.is_inline() || second.is_inline()) {
+				KVector temp(std::move(first));
+				first = std::move(second);
+				second = std::move(temp);
+				return;
+			}
 			using std::swap;
 			swap(first.items, second.items);
 			swap(first.num_items, second.num_items);
@@ -191,10 +279,73 @@ template <typename T, typename Allocator> class KVector {
 		}
 
 	private:
+		/* Where inline elements go. With no inline space, an empty KVector just
+		 * points at nothing. */
+		constexpr pointer inline_data() const {
+			if constexpr (InlineCapacity == 0) {
+				return nullptr;
+			} else {
+				return reinterpret_cast<pointer>(
+					const_cast<std::byte *>(inline_storage.bytes));
+			}
+		}
+
+		constexpr bool is_inline() const {
+			return InlineCapacity != 0 && items == inline_data();
+		}
+
+		/* Give back the current allocation (if there is one) and go back to
+		 * the (empty) inline storage. Elements must already be destroyed. */
+		void release() {
+			if (!is_inline()) {
+				a.deallocate(items, m_capacity);
+			}
+			items = inline_data();
+			m_capacity = InlineCapacity;
+		}
+
+		/* Take other's elements (and allocation, if it has one), leaving it
+		 * empty. This must be empty and not have an allocation. */
+		constexpr void take(KVector &other) {
+			a = other.a;
+			if constexpr (InlineCapacity != 0) {
+				if (other.is_inline()) {
+					std::uninitialized_move(begin(other), end(other), items);
+					std::destroy_n(other.items, other.num_items);
+					num_items = other.num_items;
+					other.num_items = 0;
+					return;
+				}
+			}
+			items = other.items;
+			num_items = other.num_items;
+			m_capacity = other.m_capacity;
+			other.items = other.inline_data();
+			other.num_items = 0;
+			other.m_capacity = InlineCapacity;
+		}
+
+		/* Make sure there is space for count more items, growing according to
+		 * the Growth policy if there isn't */
+		void grow_for(size_t count) {
+			if (num_items + count <= m_capacity) {
+				return;
+			}
+			reserve(Growth::next_capacity(m_capacity, num_items + count));
+		}
+
+		/* Declared first, since items starts out pointing to it */
+		[[no_unique_address]] KInlineStorage<T, InlineCapacity> inline_storage;
 		pointer items;
 		size_t num_items;
 		size_t m_capacity;
 		Allocator a;
 };
 
+/* A KVector that can hold N elements before it needs to allocate. Moving one
+ * moves the elements if they are stored inline, so don't keep pointers to them
+ * across a move. */
+template <typename T, size_t N, typename Allocator = KGeneralAllocator<T>>
+using KSmallVector = KVector<T, Allocator, KGeometricGrowth<>, N>;
+
 #endif /* _FELINE_KVECTOR_H */
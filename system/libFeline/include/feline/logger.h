@@ -33,8 +33,8 @@ class kout {
 		kout &operator<<(char c);
 
 	private:
-		KVector<KStringView, KGeneralAllocator<KStringView>> strings;
-		KVector<KString, KGeneralAllocator<KString>> lifetime_extender;
+		/* The line being built. Most lines fit without allocating. */
+		KSmallVector<char, 256> line;
 		void add_part(KStringView const str);
 		void do_write();
 		void (*func)(const char *, size_t);
@@ -113,6 +113,7 @@ GEN_LOG_INLINE(kDbg, debug, true);
  * This was meant for (de)allocation code, but you still
  * to format addresses and numbers. */
 GEN_LOG_INLINE(kCriticalNoAlloc, critical, false);
+GEN_LOG_INLINE(kWarningNoAlloc, warning, false);
 GEN_LOG_INLINE(kDbgNoAlloc, debug, false);
 
 #undef GEN_LOG_INLINE
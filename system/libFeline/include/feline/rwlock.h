@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef _FELINE_RWLOCK_H
+#define _FELINE_RWLOCK_H 1
+
+#include <atomic>
+#include <cstdint>
+#include <feline/cpp_only.h>
+#include <feline/spinlock.h>
+
+/* A spinning reader-writer lock: any number of readers can hold it at once,
+ * or one writer. Readers only touch a shared counter, so they never wait for
+ * each other. A waiting writer stops new readers from getting in, so a steady
+ * stream of them can't starve it. Like the other locks, interrupts are
+ * disabled while it's held (only in freestanding). */
+class RWSpinlock {
+	public:
+		/* Readers can't keep their interrupt state in the lock (there may be
+		 * lots of them), so give the return value back to release_read */
+		[[nodiscard("Pass this to release_read")]] uint32_t acquire_read();
+		void release_read(uint32_t flags);
+
+		void acquire_write();
+		[[nodiscard("Did you mean acquire_write?")]] bool try_acquire_write();
+		void release_write();
+
+		/* Writers take a KernelLock between themselves, so they are counted by
+		 * it */
+		LockStats write_stats() const { return writers.stats(); }
+		IrqsOffStats write_irqs_off_stats() const {
+			return writers.irqs_off_stats();
+		}
+		/* Readers' sections, from acquire_read to release_read, counted
+		 * across all of them */
+		IrqsOffStats read_irqs_off_stats() const {
+#if defined(IRQS_OFF_STATS) && defined(TIME_IRQS_OFF)
+			return read_irqs_off;
+#else
+			return {};
+#endif
+		}
+
+	private:
+		/* Like LockStatsCounter's, but the start time is kept per CPU */
+#ifdef TIME_IRQS_OFF
+		void read_irqs_off_start(uint32_t flags);
+		uint64_t read_irqs_off_end(uint32_t flags);
+		void read_irqs_off_check(uint64_t ns) const;
+#else
+		void read_irqs_off_start(uint32_t) {}
+		uint64_t read_irqs_off_end(uint32_t) { return 0; }
+		void read_irqs_off_check(uint64_t) const {}
+#endif
+
+		KernelLock writers;
+		/* Set while a writer holds or is waiting for the lock */
+		std::atomic<bool> writer{false};
+		std::atomic<uint32_t> readers{0};
+#if defined(IRQS_OFF_STATS) && defined(TIME_IRQS_OFF)
+		/* Readers can finish together, so they take turns to update this */
+		std::atomic_flag read_irqs_off_lock{};
+		IrqsOffStats read_irqs_off;
+#endif
+};
+
+#endif /* _FELINE_RWLOCK_H */
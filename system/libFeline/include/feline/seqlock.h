@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef _FELINE_SEQLOCK_H
+#define _FELINE_SEQLOCK_H 1
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <feline/cpp_only.h>
+#include <type_traits>
+
+/* Holds a small value that is read much more often than it is written, like
+ * the time. Readers never block or write anything shared; they just try again
+ * if a write happened while they were reading. Writers must not race each
+ * other, and a reader interrupting a writer on the same CPU would spin
+ * forever, so only write from one place with interrupts disabled (e.g. an
+ * interrupt handler) or under a lock that disables them. */
+template <typename T> class Seqlock {
+		static_assert(std::is_trivially_copyable_v<T>,
+		              "Seqlock copies values a word at a time");
+
+	public:
+		Seqlock() : Seqlock(T{}) {}
+		Seqlock(T const &value) { store_words(value); }
+		Seqlock(Seqlock const &other) : Seqlock(other.read()) {}
+		Seqlock &operator=(Seqlock const &other) {
+			write(other.read());
+			return *this;
+		}
+
+		T read() const {
+			while (true) {
+				uint32_t before = sequence.load(std::memory_order_acquire);
+				if (before & 1) {
+					/* A write is in progress */
+					continue;
+				}
+				T value = load_words();
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (sequence.load(std::memory_order_relaxed) == before) {
+					return value;
+				}
+			}
+		}
+
+		void write(T const &value) {
+			uint32_t before = sequence.load(std::memory_order_relaxed);
+			sequence.store(before + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			store_words(value);
+			sequence.store(before + 2, std::memory_order_release);
+		}
+
+	private:
+		static constexpr size_t NUM_WORDS =
+			(sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+		/* Each word is atomic so reading one mid-write isn't a data race,
+		 * it's just thrown away */
+		T load_words() const {
+			uint32_t copy[NUM_WORDS];
+			for (size_t i = 0; i < NUM_WORDS; ++i) {
+				copy[i] = words[i].load(std::memory_order_relaxed);
+			}
+			T value;
+			std::memcpy(&value, copy, sizeof(T));
+			return value;
+		}
+		void store_words(T const &value) {
+			uint32_t copy[NUM_WORDS] = {0};
+			std::memcpy(copy, &value, sizeof(T));
+			for (size_t i = 0; i < NUM_WORDS; ++i) {
+				words[i].store(copy[i], std::memory_order_relaxed);
+			}
+		}
+
+		/* Odd while a write is in progress */
+		std::atomic<uint32_t> sequence{0};
+		std::atomic<uint32_t> words[NUM_WORDS];
+};
+
+#endif /* _FELINE_SEQLOCK_H */
@@ -5,6 +5,7 @@
 
 #include <feline/kernel_exceptions.h>
 #include <feline/logger.h>
+#include <feline/seqlock.h>
 
 template <typename T, bool changeable> class Setting {
 	public:
@@ -60,7 +61,7 @@ typedef void (*output_func)(const char *, size_t);
 	_S(Settings::Logging::output_func, true, Logging, warning)                 \
 	_S(Settings::Logging::output_func, true, Logging, log)                     \
 	_S(Settings::Logging::output_func, true, Logging, debug)                   \
-	_S(unsigned long long, true, Time, ns_since_boot)
+	_S(Seqlock<unsigned long long>, true, Time, ns_since_boot)
 
 #define _S(type, modifiable, ns, name)                                         \
 	namespace ns {                                                             \
@@ -4,10 +4,106 @@
 #define _HEADER_H 1
 
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <feline/cpp_only.h>
 
-/* A basic spinlock implementation */
-class Spinlock {
+/* How much a lock has been fought over. Only counted if LOCK_STATS is
+ * defined. */
+struct LockStats {
+		uint64_t acquisitions = 0;
+		/* Acquisitions that had to wait for someone else to release it */
+		uint64_t contended = 0;
+		/* How many times waiters went round their spin loops in total */
+		uint64_t spins = 0;
+};
+
+/* How long a lock has kept interrupts disabled, from the acquire that disabled
+ * them to the release that enabled them again. Only counted if IRQS_OFF_STATS
+ * is defined. */
+struct IrqsOffStats {
+		/* Sections by length: under 1us, 4us, 16us, 64us, 256us, 1ms, 4ms,
+		 * and longer */
+		static constexpr size_t NUM_BUCKETS = 8;
+		uint64_t sections = 0;
+		uint64_t total_ns = 0;
+		uint64_t max_ns = 0;
+		uint64_t buckets[NUM_BUCKETS] = {};
+};
+
+/* Whether locks time how long they keep interrupts disabled, for
+ * IRQS_OFF_STATS or the kernel's LATENCY_BENCH */
+#if (defined(IRQS_OFF_STATS) || defined(LATENCY_BENCH)) &&                    \
+	!defined(LIBFELINE_ONLY)
+#define TIME_IRQS_OFF 1
+#endif
+
+/* Every lock type keeps its stats the same way */
+class LockStatsCounter {
+	public:
+		/* Only updated while the lock is held, so this may be slightly out
+		 * of date */
+		LockStats stats() const {
+#ifdef LOCK_STATS
+			return counters;
+#else
+			return {};
+#endif
+		}
+		IrqsOffStats irqs_off_stats() const {
+#if defined(IRQS_OFF_STATS) && defined(TIME_IRQS_OFF)
+			return irqs_off;
+#else
+			return {};
+#endif
+		}
+
+	protected:
+		/* Call with the lock held */
+		void count_acquisition([[maybe_unused]] bool contended,
+		                       [[maybe_unused]] uint64_t spins) {
+#ifdef LOCK_STATS
+			counters.acquisitions += 1;
+			counters.contended += contended;
+			counters.spins += spins;
+#endif
+		}
+
+		/* Call irqs_off_start just after acquiring the lock, and irqs_off_end
+		 * just before releasing it, with the flags the release restores. That
+		 * returns how long interrupts were off if it's turning them back on
+		 * (only the outermost lock counts), and 0 otherwise. Pass that to
+		 * irqs_off_check once the lock is released but interrupts aren't
+		 * restored yet, so a long section can be logged without holding
+		 * the lock. */
+#ifdef TIME_IRQS_OFF
+		void irqs_off_start();
+		uint64_t irqs_off_end(uint32_t flags);
+		void irqs_off_check(uint64_t ns) const;
+#else
+		void irqs_off_start() {}
+		uint64_t irqs_off_end(uint32_t) { return 0; }
+		void irqs_off_check(uint64_t) const {}
+#endif
+
+	private:
+#ifdef LOCK_STATS
+		LockStats counters;
+#endif
+#ifdef TIME_IRQS_OFF
+		uint64_t irqs_off_since;
+#ifdef IRQS_OFF_STATS
+		IrqsOffStats irqs_off;
+#endif
+#endif
+};
+
+/* All the locks here disable interrupts while held (only in freestanding), and
+ * have the same interface, so they can be swapped for each other. */
+
+/* A basic spinlock implementation. Cheapest when uncontended, but waiters all
+ * hammer the same cache line and no-one is guaranteed to ever get it. */
+class Spinlock : public LockStatsCounter {
 	public:
 		/* Wait to acquire the lock */
 		void acquire_lock();
@@ -21,8 +117,51 @@ class Spinlock {
 		std::atomic_flag lock{};
 		/* For not having interrupts occur when we are locked, only applies to freestanding. */
 		uint32_t stored_flags;
-		uint32_t disable_interrupts();
-		void restore_interrupts(uint32_t flags);
 };
 
+/* Waiters take a ticket and are let in in order. Still one shared cache line,
+ * but waiters only read it. */
+class TicketLock : public LockStatsCounter {
+	public:
+		void acquire_lock();
+		[[nodiscard("Did you mean acquire_lock?")]] bool try_acquire_lock();
+		void release_lock();
+
+	private:
+		std::atomic<uint32_t> next_ticket{0};
+		std::atomic<uint32_t> now_serving{0};
+		uint32_t stored_flags;
+};
+
+/* An MCS queue lock: each waiter spins on its own node, and the holder hands
+ * the lock straight to the next one in order. This is the K42 variant, where
+ * the lock itself stands in for the holder's node, so waiters can keep theirs
+ * on the stack and the interface doesn't need one passed in. */
+class MCSLock : public LockStatsCounter {
+	public:
+		void acquire_lock();
+		[[nodiscard("Did you mean acquire_lock?")]] bool try_acquire_lock();
+		void release_lock();
+
+	private:
+		struct Node {
+				/* For the lock's node, the last waiter (or the lock itself if
+				 * there are none, or nullptr if it's free). For a waiter's,
+				 * whether it is still waiting. */
+				std::atomic<Node *> tail{nullptr};
+				std::atomic<Node *> next{nullptr};
+		};
+		/* A waiter's tail until it's given the lock */
+		static Node *waiting();
+		Node queue;
+		uint32_t stored_flags;
+};
+
+/* The lock type used for the busiest kernel locks (the PMM, page tables and
+ * heap), chosen by CMake */
+#ifndef KERNEL_LOCK_TYPE
+#define KERNEL_LOCK_TYPE Spinlock
+#endif
+using KernelLock = KERNEL_LOCK_TYPE;
+
 #endif /* _HEADER_H */
@@ -4,7 +4,14 @@
 #include <cstdlib>
 #include <feline/kallocator.h>
 
+#ifdef LIBFELINE_ONLY
+size_t get_memory_calls = 0;
+#endif
+
 void *get_memory(size_t min_len) {
+#ifdef LIBFELINE_ONLY
+	++get_memory_calls;
+#endif
 	void *addr;
 	if (!(addr = malloc(min_len))) {
 		std::abort();
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <cstdint>
+#include <feline/align.h>
+#include <feline/kallocator.h>
+#include <feline/karena.h>
+
+KArena::KArena(size_t chunk_size) : chunks(nullptr), chunk_size(chunk_size) {}
+
+KArena::~KArena() {
+	while (chunks) {
+		Chunk *next = chunks->next;
+		return_memory(chunks, sizeof(Chunk) + chunks->size);
+		chunks = next;
+	}
+}
+
+KArena::Chunk *KArena::new_chunk(size_t min_size) {
+	size_t size = min_size > chunk_size ? min_size : chunk_size;
+	auto *chunk = static_cast<Chunk *>(get_memory(sizeof(Chunk) + size));
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->next = chunks;
+	chunks = chunk;
+	return chunk;
+}
+
+void *KArena::allocate(size_t len, size_t align) {
+	if (chunks) {
+		uintptr_t start = reinterpret_cast<uintptr_t>(chunks->data());
+		uintptr_t addr = round_up_to_alignment(start + chunks->used, align);
+		if (addr - start <= chunks->size && len <= chunks->size - (addr - start)) {
+			chunks->used = addr - start + len;
+			return reinterpret_cast<void *>(addr);
+		}
+	}
+	/* Leave room to align the start of the allocation */
+	Chunk *chunk = new_chunk(len + align - 1);
+	uintptr_t start = reinterpret_cast<uintptr_t>(chunk->data());
+	uintptr_t addr = round_up_to_alignment(start, align);
+	chunk->used = addr - start + len;
+	return reinterpret_cast<void *>(addr);
+}
+
+void KArena::deallocate(void *addr, size_t len) {
+	if (!chunks) {
+		return;
+	}
+	auto end = reinterpret_cast<uintptr_t>(addr) + len;
+	if (end == reinterpret_cast<uintptr_t>(chunks->data()) + chunks->used) {
+		chunks->used -= len;
+	}
+}
+
+void KArena::reset() {
+	Chunk *keep = nullptr;
+	while (chunks) {
+		Chunk *next = chunks->next;
+		if (!keep && chunks->size == chunk_size) {
+			keep = chunks;
+		} else {
+			return_memory(chunks, sizeof(Chunk) + chunks->size);
+		}
+		chunks = next;
+	}
+	if (keep) {
+		keep->used = 0;
+		keep->next = nullptr;
+	}
+	chunks = keep;
+}
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+#ifndef _FELINE_LOCKING_INTERRUPTS_H
+#define _FELINE_LOCKING_INTERRUPTS_H 1
+
+/* Shared by the lock implementations, not part of libFeline's interface */
+
+#include <cstdint>
+#include <feline/spinlock.h>
+
+// TODO: find a better home for this
+// https://stackoverflow.com/a/54920142
+#ifdef _MSC_VER
+#include <intrin.h>
+#define NOP() __nop()       // _emit 0x90
+#else
+// assume __GNUC__ inline asm
+#define NOP() asm("nop")    // implicitly volatile
+#endif
+
+// This should be in the kernel, not libFeline. However, it is much simpler to have in this class
+#ifndef LIBFELINE_ONLY
+#ifdef __i386__
+static inline uint32_t disable_interrupts() {
+	uint32_t flags;
+	asm volatile ("pushf; cli; pop %0" : "=r"(flags) : : "memory");
+	return flags;
+}
+static inline void restore_interrupts(uint32_t flags) {
+	asm("push %0; popf;" : : "rm"(flags) : "memory", "cc");
+	return;
+}
+#elifdef __arm__
+static inline uint32_t disable_interrupts() {
+	uint32_t flags;
+	asm volatile ("mrs %0, cpsr; cpsid if; and %0, %0, #0xc0" : "=r"(flags) : : "memory");
+	return flags;
+}
+static inline void restore_interrupts(uint32_t flags) {
+	uint32_t tmp;
+	asm("mrs r0, cpsr; bic r0, r0, %0; msr cpsr, %0" : : "r"(flags) : "r0", "memory", "cc");
+}
+#else
+#error "Unsupported architecture, cannot disable interupts!"
+#endif
+#else
+static inline uint32_t disable_interrupts() {return 0;}
+static inline void restore_interrupts(uint32_t) {}
+#endif
+
+/* Whether disable_interrupts found them enabled, going by what it returned */
+static inline bool interrupts_were_enabled([[maybe_unused]] uint32_t flags) {
+#ifdef LIBFELINE_ONLY
+	return false;
+#elifdef __i386__
+	return (flags & (1 << 9)) != 0;
+#else
+	return (flags & (1 << 7)) == 0;
+#endif
+}
+
+/* Where the locks report how long they kept interrupts disabled, in the
+ * kernel */
+#ifdef TIME_IRQS_OFF
+uint64_t now_ns();
+/* When this CPU's outermost read lock disabled interrupts. Readers share the
+ * lock, so they can't keep it there like the other locks do. */
+uint64_t *this_cpu_read_irqs_off_since();
+#ifdef LATENCY_BENCH
+void latency_bench_irqs_off(uint64_t ns);
+#endif
+#ifdef IRQS_OFF_STATS
+/* Sections at least this long are passed to report_long_irqs_off */
+extern uint64_t irqs_off_threshold_ns;
+void report_long_irqs_off(void const *lock, uint64_t ns);
+/* Count a section of ns in stats, in spinlock.cpp */
+void record_irqs_off(IrqsOffStats &stats, uint64_t ns);
+#endif
+#endif
+
+#endif /* _FELINE_LOCKING_INTERRUPTS_H */
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <feline/rwlock.h>
+#include "interrupts.h"
+
+/* NOTE: the reader and writer each store their flag and then check the other's,
+ * so these need to be seq_cst: with anything weaker both could miss the
+ * other's store and get in together. */
+
+uint32_t RWSpinlock::acquire_read() {
+	uint32_t flags = disable_interrupts();
+	while (true) {
+		while (writer.load(std::memory_order_relaxed)) {
+			NOP();
+		}
+		readers.fetch_add(1);
+		if (!writer.load()) {
+			read_irqs_off_start(flags);
+			return flags;
+		}
+		/* A writer got in first, so back off until it's done */
+		readers.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+void RWSpinlock::release_read(uint32_t flags) {
+	uint64_t irqs_off_ns = read_irqs_off_end(flags);
+	readers.fetch_sub(1, std::memory_order_release);
+	read_irqs_off_check(irqs_off_ns);
+	restore_interrupts(flags);
+}
+
+#ifdef TIME_IRQS_OFF
+void RWSpinlock::read_irqs_off_start(uint32_t flags) {
+	/* Only the outermost section on a CPU is timed, so a nested reader must
+	 * leave the outer one's start time alone */
+	if (interrupts_were_enabled(flags)) {
+		*this_cpu_read_irqs_off_since() = now_ns();
+	}
+}
+
+uint64_t RWSpinlock::read_irqs_off_end(uint32_t flags) {
+	if (!interrupts_were_enabled(flags)) {
+		return 0;
+	}
+	uint64_t ns = now_ns() - *this_cpu_read_irqs_off_since();
+#ifdef LATENCY_BENCH
+	latency_bench_irqs_off(ns);
+#endif
+#ifdef IRQS_OFF_STATS
+	while (read_irqs_off_lock.test_and_set(std::memory_order_acquire)) {
+		NOP();
+	}
+	record_irqs_off(read_irqs_off, ns);
+	read_irqs_off_lock.clear(std::memory_order_release);
+#endif
+	return ns;
+}
+
+void RWSpinlock::read_irqs_off_check([[maybe_unused]] uint64_t ns) const {
+#ifdef IRQS_OFF_STATS
+	if (ns >= irqs_off_threshold_ns) {
+		report_long_irqs_off(this, ns);
+	}
+#endif
+}
+#endif // TIME_IRQS_OFF
+
+void RWSpinlock::acquire_write() {
+	writers.acquire_lock();
+	writer.store(true);
+	while (readers.load() != 0) {
+		NOP();
+	}
+}
+
+bool RWSpinlock::try_acquire_write() {
+	if (!writers.try_acquire_lock()) {
+		return false;
+	}
+	writer.store(true);
+	if (readers.load() != 0) {
+		writer.store(false, std::memory_order_relaxed);
+		writers.release_lock();
+		return false;
+	}
+	return true;
+}
+
+void RWSpinlock::release_write() {
+	writer.store(false, std::memory_order_release);
+	writers.release_lock();
+}
@@ -1,55 +1,62 @@
 #include <feline/spinlock.h>
+#include "interrupts.h"
 
-// TODO: find a better home for this
-// https://stackoverflow.com/a/54920142
-#ifdef _MSC_VER
-#include <intrin.h>
-#define NOP() __nop()       // _emit 0x90
-#else
-// assume __GNUC__ inline asm
-#define NOP() asm("nop")    // implicitly volatile
+#ifdef TIME_IRQS_OFF
+#ifdef IRQS_OFF_STATS
+void record_irqs_off(IrqsOffStats &stats, uint64_t ns) {
+	stats.sections += 1;
+	stats.total_ns += ns;
+	stats.max_ns = ns > stats.max_ns ? ns : stats.max_ns;
+	/* Each bucket is 4 times as long as the last, starting at 1us */
+	size_t bucket = 0;
+	uint64_t limit = 1'000;
+	while (ns >= limit && bucket + 1 < IrqsOffStats::NUM_BUCKETS) {
+		++bucket;
+		limit *= 4;
+	}
+	stats.buckets[bucket] += 1;
+}
 #endif
 
-// This should be in the kernel, not libFeline. However, it is much simpler to have in this class
-#ifndef LIBFELINE_ONLY
-#ifdef __i386__
-inline uint32_t Spinlock::disable_interrupts() {
-	uint32_t flags;
-	asm volatile ("pushf; cli; pop %0" : "=r"(flags) : : "memory");
-	return flags;
-}
-inline void Spinlock::restore_interrupts(uint32_t flags) {
-	asm("push %0; popf;" : : "rm"(flags) : "memory", "cc");
-	return;
-}
-#elifdef __arm__
-inline uint32_t Spinlock::disable_interrupts() {
-	uint32_t flags;
-	asm volatile ("mrs %0, cpsr; cpsid if; and %0, %0, #0xc0" : "=r"(flags) : : "memory");
-	return flags;
-}
-inline void Spinlock::restore_interrupts(uint32_t flags) {
-	uint32_t tmp;
-	asm("mrs r0, cpsr; bic r0, r0, %0; msr cpsr, %0" : : "r"(flags) : "r0", "memory", "cc");
-}
-#else
-#error "Unsupported architecture, cannot disable interupts!"
+void LockStatsCounter::irqs_off_start() { irqs_off_since = now_ns(); }
+
+uint64_t LockStatsCounter::irqs_off_end(uint32_t flags) {
+	if (!interrupts_were_enabled(flags)) {
+		return 0;
+	}
+	uint64_t ns = now_ns() - irqs_off_since;
+#ifdef LATENCY_BENCH
+	latency_bench_irqs_off(ns);
 #endif
-#else
-inline uint32_t Spinlock::disable_interrupts() {return 0;}
-inline void Spinlock::restore_interrupts(uint32_t flags) {}
+#ifdef IRQS_OFF_STATS
+	record_irqs_off(irqs_off, ns);
 #endif
+	return ns;
+}
+
+void LockStatsCounter::irqs_off_check([[maybe_unused]] uint64_t ns) const {
+#ifdef IRQS_OFF_STATS
+	if (ns >= irqs_off_threshold_ns) {
+		report_long_irqs_off(this, ns);
+	}
+#endif
+}
+#endif // TIME_IRQS_OFF
 
 /* Wait to get the lock */
 void Spinlock::acquire_lock() {
 	uint32_t flags = disable_interrupts(); /* Disable interrupts */
-	/* If the lock is true (not held), loop */
+	/* If the lock is true (held), loop */
 	/* Once it is false, atomically replace with true and continue */
-	while (!lock.test_and_set(std::memory_order_acquire)) {
+	uint64_t spins = 0;
+	while (lock.test_and_set(std::memory_order_acquire)) {
 		/* If it wasn't 0, relax the CPU so hyper-threading is more efficient */
 		NOP();
+		++spins;
 	}
 	stored_flags = flags; /* Save the previous interrupt state for later */
+	count_acquisition(spins != 0, spins);
+	irqs_off_start();
 	/* Once it was 0 (released by someone else) */
 	/*	We already set it to 1 */
 	return;
@@ -57,9 +64,12 @@ void Spinlock::acquire_lock() {
 
 bool Spinlock::try_acquire_lock() {
 	uint32_t flags = disable_interrupts();
-	bool result = lock.test_and_set(std::memory_order_acquire);
+	/* We got it if it wasn't already held */
+	bool result = !lock.test_and_set(std::memory_order_acquire);
 	if (result) {
 		stored_flags = flags; /* Save the previous interrupt state for later, but don't clobber the current holder's state */
+		count_acquisition(false, 0);
+		irqs_off_start();
 	}
 	else {
 		restore_interrupts(flags); /* Don't leave interrupts disabled if we don't have the lock. */
@@ -70,7 +80,138 @@ bool Spinlock::try_acquire_lock() {
 void Spinlock::release_lock() {
 	/* Release the lock */
 	uint32_t flags = stored_flags; /* Avoid race conditions when we release the lock. */
+	uint64_t irqs_off_ns = irqs_off_end(flags);
 	lock.clear(std::memory_order_release);
+	irqs_off_check(irqs_off_ns);
 	restore_interrupts(flags); /* Re-enable interrupts if they were enabled before. */
 	return;
 }
+
+void TicketLock::acquire_lock() {
+	uint32_t flags = disable_interrupts();
+	uint32_t ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+	uint64_t spins = 0;
+	while (now_serving.load(std::memory_order_acquire) != ticket) {
+		NOP();
+		++spins;
+	}
+	stored_flags = flags;
+	count_acquisition(spins != 0, spins);
+	irqs_off_start();
+}
+
+bool TicketLock::try_acquire_lock() {
+	uint32_t flags = disable_interrupts();
+	/* It's free if nobody has a ticket that isn't being served yet */
+	uint32_t ticket = now_serving.load(std::memory_order_relaxed);
+	bool result = next_ticket.compare_exchange_strong(
+		ticket, ticket + 1, std::memory_order_acquire, std::memory_order_relaxed);
+	if (result) {
+		stored_flags = flags;
+		count_acquisition(false, 0);
+		irqs_off_start();
+	} else {
+		restore_interrupts(flags);
+	}
+	return result;
+}
+
+void TicketLock::release_lock() {
+	uint32_t flags = stored_flags;
+	uint64_t irqs_off_ns = irqs_off_end(flags);
+	/* Only the holder writes now_serving, so this doesn't need to be atomic */
+	now_serving.store(now_serving.load(std::memory_order_relaxed) + 1,
+	                  std::memory_order_release);
+	irqs_off_check(irqs_off_ns);
+	restore_interrupts(flags);
+}
+
+MCSLock::Node *MCSLock::waiting() { return reinterpret_cast<Node *>(1); }
+
+void MCSLock::acquire_lock() {
+	uint32_t flags = disable_interrupts();
+	uint64_t spins = 0;
+	bool contended = false;
+	while (true) {
+		Node *prev = queue.tail.load(std::memory_order_relaxed);
+		if (!prev) {
+			/* It looks free, so try to take it with the lock's own node */
+			if (queue.tail.compare_exchange_strong(prev, &queue,
+			                                       std::memory_order_acquire)) {
+				break;
+			}
+			continue;
+		}
+		/* Interrupts are disabled, so this stays valid while we're queued */
+		Node node;
+		node.tail.store(waiting(), std::memory_order_relaxed);
+		if (!queue.tail.compare_exchange_strong(prev, &node,
+		                                        std::memory_order_acq_rel)) {
+			continue;
+		}
+		contended = true;
+		prev->next.store(&node, std::memory_order_release);
+		while (node.tail.load(std::memory_order_acquire) == waiting()) {
+			NOP();
+			++spins;
+		}
+		/* We have the lock, so hand our place in the queue over to the lock's
+		 * node before our own goes away */
+		Node *succ = node.next.load(std::memory_order_acquire);
+		if (!succ) {
+			queue.next.store(nullptr, std::memory_order_relaxed);
+			Node *expected = &node;
+			if (!queue.tail.compare_exchange_strong(
+					expected, &queue, std::memory_order_acq_rel)) {
+				/* Someone queued behind us, wait for them to link in */
+				while (!(succ = node.next.load(std::memory_order_acquire))) {
+					NOP();
+				}
+				queue.next.store(succ, std::memory_order_relaxed);
+			}
+		} else {
+			queue.next.store(succ, std::memory_order_relaxed);
+		}
+		break;
+	}
+	stored_flags = flags;
+	count_acquisition(contended, spins);
+	irqs_off_start();
+}
+
+bool MCSLock::try_acquire_lock() {
+	uint32_t flags = disable_interrupts();
+	Node *expected = nullptr;
+	bool result = queue.tail.compare_exchange_strong(
+		expected, &queue, std::memory_order_acquire, std::memory_order_relaxed);
+	if (result) {
+		stored_flags = flags;
+		count_acquisition(false, 0);
+		irqs_off_start();
+	} else {
+		restore_interrupts(flags);
+	}
+	return result;
+}
+
+void MCSLock::release_lock() {
+	uint32_t flags = stored_flags;
+	uint64_t irqs_off_ns = irqs_off_end(flags);
+	Node *succ = queue.next.load(std::memory_order_acquire);
+	if (!succ) {
+		Node *expected = &queue;
+		if (queue.tail.compare_exchange_strong(expected, nullptr,
+		                                       std::memory_order_release)) {
+			irqs_off_check(irqs_off_ns);
+			restore_interrupts(flags);
+			return;
+		}
+		/* Someone is queueing, wait for them to link in */
+		while (!(succ = queue.next.load(std::memory_order_acquire))) {
+			NOP();
+		}
+	}
+	succ->tail.store(nullptr, std::memory_order_release);
+	irqs_off_check(irqs_off_ns);
+	restore_interrupts(flags);
+}
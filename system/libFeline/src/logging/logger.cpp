@@ -65,9 +65,9 @@ kout::~kout() {
 
 void kout::add_part(KStringView const str) {
 	// if we aren't allocating, write it out immediately (breaks atomic writes)
-	// otherwise, save it for later
+	// otherwise, copy it into the line for later
 	if (alloc) {
-		strings.append(str);
+		line.append(begin(str), end(str));
 	} else {
 		func(str.data(), str.size());
 	}
@@ -76,19 +76,8 @@ void kout::add_part(KStringView const str) {
 void kout::do_write() {
 	// if alloc is false, func should be called directly instead of calling this
 	assert(alloc);
-	size_t total_length = 0;
-	for (auto &str : strings) {
-		total_length += str.length();
-	}
-	KString full_string;
-	full_string.append('\0', total_length);
-	size_t current_index = 0;
-	for (auto &str : strings) {
-		std::copy(begin(str), end(str), &full_string[current_index]);
-		current_index += str.length();
-	}
 	output_lock.acquire_lock();
-	func(full_string.data(), full_string.size());
+	func(line.data(), line.size());
 	output_lock.release_lock();
 	return;
 }
@@ -99,29 +88,12 @@ kout &kout::operator<<(KStringView const str) {
 }
 
 kout &kout::operator<<(KString const str) {
-	if (alloc) {
-		lifetime_extender.append(std::move(str));
-		/* We need to use a reference to the data in lifetime_extender, since it
-		 * is moved from str (which otherwise gets destructed at the end of this
-		 * function)
-		 */
-		add_part(KStringView(end(lifetime_extender)[-1].data(),
-		                     end(lifetime_extender)[-1].size()));
-	} else {
-		add_part(KStringView(str.data(), str.size()));
-	}
+	add_part(KStringView(str.data(), str.size()));
 	return *this;
 }
 
 kout &kout::operator<<(char c) {
-	if (!alloc) {
-		add_part(KStringView(&c, 1));
-	} else {
-		// Force KString to make an allocation, so it doesn't get clobbered
-		KString temp_string;
-		temp_string.append(c);
-		return *this << temp_string;
-	}
+	add_part(KStringView(&c, 1));
 	return *this;
 }
 
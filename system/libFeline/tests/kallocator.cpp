@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <cstdint>
+#include <feline/kallocator.h>
+#include <feline/tests.h>
+
+static void fill(void *addr, size_t len, uint8_t value) {
+	auto *bytes = static_cast<uint8_t *>(addr);
+	for (size_t i = 0; i < len; ++i) {
+		bytes[i] = value;
+	}
+}
+
+static bool filled_with(void const *addr, size_t len, uint8_t value) {
+	auto const *bytes = static_cast<uint8_t const *>(addr);
+	for (size_t i = 0; i < len; ++i) {
+		if (bytes[i] != value) {
+			return false;
+		}
+	}
+	return true;
+}
+
+ADD_TEST(kallocator) {
+	initialize_loggers();
+
+	/* Blocks bigger than a page come back whole, and the heap still works
+	 * after freeing them */
+	void *big = get_memory(3 * 4096 + 100);
+	fill(big, 3 * 4096 + 100, 0x5A);
+	REQUIRE(filled_with(big, 3 * 4096 + 100, 0x5A));
+	return_memory(big, 3 * 4096 + 100);
+	void *small = get_memory(64);
+	fill(small, 64, 0x11);
+	REQUIRE(filled_with(small, 64, 0x11));
+
+	/* Free a multi-page block while something after it in the same region is
+	 * still in use */
+	void *first = get_memory(6000);
+	void *second = get_memory(100);
+	fill(first, 6000, 0x22);
+	fill(second, 100, 0x33);
+	return_memory(first, 6000);
+	REQUIRE(filled_with(second, 100, 0x33));
+	void *again = get_memory(200);
+	fill(again, 200, 0x44);
+	REQUIRE(filled_with(second, 100, 0x33));
+	return_memory(second, 100);
+	return_memory(again, 200);
+
+	REQUIRE(filled_with(small, 64, 0x11));
+	return_memory(small, 64);
+	return 0;
+}
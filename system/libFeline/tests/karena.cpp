@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <feline/karena.h>
+#include <feline/tests.h>
+
+ADD_TEST(karena) {
+	initialize_loggers();
+	KArena arena(256);
+
+	/* Allocations are aligned, and don't overlap */
+	auto *byte = static_cast<uint8_t *>(arena.allocate(1, 1));
+	auto *word = static_cast<uint64_t *>(arena.allocate(8, alignof(uint64_t)));
+	REQUIRE_EQ(reinterpret_cast<uintptr_t>(word) % alignof(uint64_t), 0uz);
+	REQUIRE(reinterpret_cast<uintptr_t>(word) >
+	        reinterpret_cast<uintptr_t>(byte));
+
+	/* Bigger than a chunk still works */
+	auto *big = static_cast<uint8_t *>(arena.allocate(1000, 1));
+	big[999] = 1;
+
+	/* A KVector can grow inside the arena */
+	{
+		KVector<uint32_t, KArenaAllocator<uint32_t>> vec{
+			KArenaAllocator<uint32_t>(arena)};
+		for (uint32_t i = 0; i < 100; ++i) {
+			vec.push_back(i);
+		}
+		REQUIRE_EQ(vec.size(), 100uz);
+		for (auto &elem : vec) {
+			REQUIRE_EQ(elem, static_cast<uint32_t>(std::distance(begin(vec), &elem)));
+		}
+		auto copy = vec;
+		REQUIRE_EQ(copy[99], 99u);
+	}
+
+	/* Giving back the most recent allocation lets it be reused */
+	void *last = arena.allocate(16, 1);
+	arena.deallocate(last, 16);
+	REQUIRE_EQ(arena.allocate(16, 1), last);
+
+	/* After a reset, the kept chunk is reused from the start */
+	arena.reset();
+	void *first = arena.allocate(1, 1);
+	arena.reset();
+	REQUIRE_EQ(arena.allocate(1, 1), first);
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <feline/kheap.h>
+#include <feline/tests.h>
+
+struct Less {
+		bool operator()(int a, int b) const { return a < b; }
+};
+
+ADD_TEST(kheap) {
+	initialize_loggers();
+	KMinHeap<int, Less> heap;
+	REQUIRE(heap.empty());
+
+	/* push returns where the element ended up */
+	for (int value : {5, 3, 8, 1, 9, 2, 7}) {
+		REQUIRE_EQ(heap.push(value), value);
+	}
+	REQUIRE_EQ(heap.size(), 7uz);
+	REQUIRE_EQ(heap.top(), 1);
+	int &pushed = heap.push(0);
+	REQUIRE_EQ(pushed, 0);
+	REQUIRE(&pushed == &heap.top());
+
+	/* Everything comes out in order */
+	int last = -1;
+	while (!heap.empty()) {
+		int value = heap.pop();
+		REQUIRE(value >= last);
+		last = value;
+	}
+	REQUIRE_EQ(last, 9);
+
+	/* Pops and pushes can be mixed, including equal elements */
+	for (int i = 0; i < 100; ++i) {
+		heap.push((i * 37) % 10);
+	}
+	for (int i = 0; i < 50; ++i) {
+		int value = heap.pop();
+		heap.push(value + 10);
+	}
+	last = -1;
+	size_t count = 0;
+	while (!heap.empty()) {
+		int value = heap.pop();
+		REQUIRE(value >= last);
+		last = value;
+		++count;
+	}
+	REQUIRE_EQ(count, 100uz);
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <feline/khistogram.h>
+#include <feline/tests.h>
+
+ADD_TEST(khistogram) {
+	initialize_loggers();
+	using Histogram = KHistogram<2>;
+
+	/* Every value lands in a bucket that contains it, and buckets are in
+	 * order with no gaps */
+	REQUIRE_EQ(Histogram::bucket_low(0), 0u);
+	for (size_t index = 0; index + 1 < Histogram::NUM_BUCKETS; ++index) {
+		REQUIRE_EQ(Histogram::bucket_high(index) + 1,
+		           Histogram::bucket_low(index + 1));
+	}
+	REQUIRE_EQ(Histogram::bucket_high(Histogram::NUM_BUCKETS - 1), UINT64_MAX);
+	uint64_t const values[] = {0, 3, 4, 5, 7, 8, 1000, uint64_t{1} << 40,
+	                           UINT64_MAX};
+	for (uint64_t value : values) {
+		size_t index = Histogram::bucket_index(value);
+		REQUIRE(index < Histogram::NUM_BUCKETS);
+		REQUIRE(Histogram::bucket_low(index) <= value);
+		REQUIRE(value <= Histogram::bucket_high(index));
+	}
+	/* Within a power of two, buckets are a quarter of it wide */
+	REQUIRE_EQ(Histogram::bucket_low(Histogram::bucket_index(1000)), 896u);
+	REQUIRE_EQ(Histogram::bucket_high(Histogram::bucket_index(1000)), 1023u);
+
+	Histogram histogram;
+	REQUIRE_EQ(histogram.count(), 0u);
+	REQUIRE_EQ(histogram.percentile(50), 0u);
+	for (uint64_t value = 1; value <= 100; ++value) {
+		histogram.record(value);
+	}
+	REQUIRE_EQ(histogram.count(), 100u);
+	REQUIRE_EQ(histogram.min(), 1u);
+	REQUIRE_EQ(histogram.max(), 100u);
+	REQUIRE_EQ(histogram.mean(), 50u);
+	/* The 50th sample (50) is in the 48-55 bucket */
+	REQUIRE_EQ(histogram.percentile(50), 55u);
+	/* Never past the largest sample */
+	REQUIRE_EQ(histogram.percentile(99), 100u);
+	REQUIRE_EQ(histogram.percentile(100), 100u);
+	REQUIRE_EQ(histogram.percentile(0), 1u);
+
+	uint64_t counted = 0;
+	uint64_t last_high = 0;
+	bool in_order = true;
+	histogram.for_each_bucket([&](uint64_t low, uint64_t high, uint64_t count) {
+		in_order = in_order && (counted == 0 || low > last_high);
+		last_high = high;
+		counted += count;
+	});
+	REQUIRE(in_order);
+	REQUIRE_EQ(counted, 100u);
+
+	Histogram other;
+	other.record(5000);
+	histogram.merge(other);
+	REQUIRE_EQ(histogram.count(), 101u);
+	REQUIRE_EQ(histogram.min(), 1u);
+	REQUIRE_EQ(histogram.max(), 5000u);
+	REQUIRE_EQ(histogram.percentile(100), 5000u);
+
+	histogram.clear();
+	REQUIRE_EQ(histogram.count(), 0u);
+	REQUIRE_EQ(histogram.max(), 0u);
+
+	return 0;
+}
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <feline/kslab.h>
+#include <feline/tests.h>
+
+static int live_objects = 0;
+
+struct Object {
+		Object(uint32_t value) : value(value) { ++live_objects; }
+		~Object() { --live_objects; }
+		uint32_t value;
+};
+
+ADD_TEST(kslab) {
+	initialize_loggers();
+	KSlab<Object, 4> slab;
+
+	/* More objects than fit in one slab, and they all stay put */
+	Object *objects[10];
+	for (uint32_t i = 0; i < 10; ++i) {
+		objects[i] = slab.create(i);
+	}
+	REQUIRE_EQ(live_objects, 10);
+	for (uint32_t i = 0; i < 10; ++i) {
+		REQUIRE_EQ(objects[i]->value, i);
+		for (uint32_t j = 0; j < i; ++j) {
+			REQUIRE(objects[i] != objects[j]);
+		}
+	}
+
+	/* A destroyed object's slot is reused before making a new slab */
+#ifdef LIBFELINE_ONLY
+	size_t calls_before = get_memory_calls;
+#endif // LIBFELINE_ONLY
+	slab.destroy(objects[3]);
+	REQUIRE_EQ(live_objects, 9);
+	Object *reused = slab.create(42u);
+	REQUIRE(reused == objects[3]);
+	REQUIRE_EQ(reused->value, 42u);
+#ifdef LIBFELINE_ONLY
+	REQUIRE_EQ(get_memory_calls, calls_before);
+#endif // LIBFELINE_ONLY
+	objects[3] = reused;
+
+	for (Object *object : objects) {
+		slab.destroy(object);
+	}
+	REQUIRE_EQ(live_objects, 0);
+
+	return 0;
+}
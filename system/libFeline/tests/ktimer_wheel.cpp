@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <feline/ktimer_wheel.h>
+#include <feline/tests.h>
+
+struct TestTimer : KTimerEntry {
+		uint64_t fired_at = 0;
+		size_t times_fired = 0;
+};
+
+ADD_TEST(ktimer_wheel) {
+	initialize_loggers();
+	KTimerWheel<2, 3> wheel(5);
+	auto fire = [&wheel](KTimerEntry &entry) {
+		auto &timer = static_cast<TestTimer &>(entry);
+		timer.fired_at = wheel.now();
+		timer.times_fired += 1;
+	};
+
+	/* One timer per level, one past the end of the wheel, and one that's
+	 * already due */
+	TestTimer near, middle, far, too_far, overdue, removed;
+	wheel.add(near, 7);
+	wheel.add(middle, 20);
+	wheel.add(far, 60);
+	wheel.add(too_far, 200);
+	wheel.add(overdue, 1);
+	wheel.add(removed, 30);
+	REQUIRE(!wheel.empty());
+	wheel.remove(removed);
+	REQUIRE(!removed.queued());
+	/* Removing twice does nothing */
+	wheel.remove(removed);
+
+	for (uint64_t tick = 6; tick <= 200; ++tick) {
+		wheel.advance(tick, fire);
+	}
+	REQUIRE_EQ(overdue.fired_at, 6u);
+	REQUIRE_EQ(near.fired_at, 7u);
+	REQUIRE_EQ(middle.fired_at, 20u);
+	REQUIRE_EQ(far.fired_at, 60u);
+	REQUIRE_EQ(too_far.fired_at, 200u);
+	REQUIRE_EQ(removed.times_fired, 0u);
+	for (TestTimer *timer : {&near, &middle, &far, &too_far, &overdue}) {
+		REQUIRE_EQ(timer->times_fired, 1u);
+		REQUIRE(!timer->queued());
+	}
+	REQUIRE(wheel.empty());
+
+	/* Jumping forward more than one tick still fires everything in between,
+	 * in order */
+	TestTimer timers[40];
+	for (size_t i = 0; i < 40; ++i) {
+		wheel.add(timers[i], 201 + i * 3);
+	}
+	uint64_t last_fired = 0;
+	bool in_order = true;
+	wheel.advance(400, [&](KTimerEntry &entry) {
+		in_order = in_order && entry.expires >= last_fired;
+		last_fired = entry.expires;
+		fire(entry);
+	});
+	REQUIRE(in_order);
+	for (size_t i = 0; i < 40; ++i) {
+		REQUIRE_EQ(timers[i].times_fired, 1u);
+		REQUIRE_EQ(timers[i].fired_at, 201 + i * 3);
+	}
+
+	/* next_event is exact for close timers, and following it never skips
+	 * past one that's further away */
+	REQUIRE_EQ(wheel.next_event(), UINT64_MAX);
+	TestTimer soon, later;
+	wheel.add(soon, 403);
+	wheel.add(later, 450);
+	REQUIRE_EQ(wheel.next_event(), 403u);
+	wheel.advance(wheel.next_event(), fire);
+	REQUIRE_EQ(soon.fired_at, 403u);
+	size_t steps = 0;
+	while (later.times_fired == 0) {
+		uint64_t next = wheel.next_event();
+		REQUIRE(next > wheel.now() && next <= 450);
+		wheel.advance(next, fire);
+		++steps;
+	}
+	REQUIRE_EQ(later.fired_at, 450u);
+	REQUIRE(steps > 1);
+	REQUIRE_EQ(wheel.next_event(), UINT64_MAX);
+
+	/* An empty wheel skips straight to the new time */
+	wheel.advance(1'000'000, fire);
+	REQUIRE_EQ(wheel.now(), 1'000'000u);
+
+	/* Callbacks can re-arm their timer */
+	TestTimer periodic;
+	wheel.add(periodic, wheel.now() + 10);
+	wheel.advance(wheel.now() + 100, [&wheel](KTimerEntry &entry) {
+		auto &timer = static_cast<TestTimer &>(entry);
+		timer.times_fired += 1;
+		wheel.add(entry, entry.expires + 10);
+	});
+	REQUIRE_EQ(periodic.times_fired, 10u);
+	REQUIRE(periodic.queued());
+
+	return 0;
+}
@@ -28,5 +28,60 @@ ADD_TEST(kvector) {
 	REQUIRE_EQ(vec.capacity(), 8uz);
 	REQUIRE_EQ(vec.size(), 0uz);
 
+	/* Growing past the capacity should over-allocate, so only a few of these
+	 * push_backs need to reallocate */
+	size_t reallocations = 0;
+	for (size_t i = 0; i < 1000; ++i) {
+		auto old_capacity = vec.capacity();
+		vec.push_back(i);
+		if (vec.capacity() != old_capacity) {
+			++reallocations;
+		}
+	}
+	REQUIRE_EQ(vec.size(), 1000uz);
+	REQUIRE(vec.capacity() >= vec.size());
+	REQUIRE(reallocations < 20);
+	for (auto &elem : vec) {
+		REQUIRE_EQ(elem, static_cast<uint8_t>(std::distance(begin(vec), &elem)));
+	}
+
+	vec.shrink_to_fit();
+	REQUIRE_EQ(vec.capacity(), 1000uz);
+	REQUIRE_EQ(vec.size(), 1000uz);
+	REQUIRE_EQ(vec[999], static_cast<uint8_t>(999));
+
+	vec.clear();
+	vec.shrink_to_fit();
+	REQUIRE_EQ(vec.capacity(), 0uz);
+
+	/* The exact policy only ever allocates what it needs */
+	KVector<uint8_t, KGeneralAllocator<uint8_t>, KExactGrowth> exact;
+	exact.push_back(1);
+	exact.append(2, 2);
+	REQUIRE_EQ(exact.capacity(), 3uz);
+
+	/* Small vectors start with (and can move back to) their inline space */
+	KSmallVector<uint8_t, 4> small;
+	REQUIRE_EQ(small.capacity(), 4uz);
+	for (uint8_t i = 0; i < 4; ++i) {
+		small.push_back(i);
+	}
+	REQUIRE_EQ(small.capacity(), 4uz);
+	auto moved = std::move(small);
+	REQUIRE_EQ(small.size(), 0uz);
+	REQUIRE_EQ(moved.size(), 4uz);
+	REQUIRE_EQ(moved[3], 3);
+	moved.push_back(4);
+	REQUIRE(moved.capacity() > 4uz);
+	REQUIRE_EQ(moved[4], 4);
+	swap(small, moved);
+	REQUIRE_EQ(small.size(), 5uz);
+	REQUIRE_EQ(moved.size(), 0uz);
+	small.erase(begin(small) + 1, end(small));
+	small.shrink_to_fit();
+	REQUIRE_EQ(small.capacity(), 4uz);
+	REQUIRE_EQ(small.size(), 1uz);
+	REQUIRE_EQ(small[0], 0);
+
 	return 0;
 }
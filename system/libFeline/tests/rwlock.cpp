@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <feline/rwlock.h>
+#include <feline/tests.h>
+
+ADD_TEST(rwlock) {
+	initialize_loggers();
+	RWSpinlock lock;
+
+	/* Readers don't keep each other out, but do keep writers out */
+	uint32_t first = lock.acquire_read();
+	uint32_t second = lock.acquire_read();
+	REQUIRE_NOT(lock.try_acquire_write());
+	lock.release_read(second);
+	REQUIRE_NOT(lock.try_acquire_write());
+	lock.release_read(first);
+
+	/* Once they're gone a writer can get in, but only one */
+	REQUIRE(lock.try_acquire_write());
+	REQUIRE_NOT(lock.try_acquire_write());
+	lock.release_write();
+
+	lock.acquire_write();
+	lock.release_write();
+	uint32_t flags = lock.acquire_read();
+	lock.release_read(flags);
+	REQUIRE(lock.try_acquire_write());
+	lock.release_write();
+
+	return 0;
+}
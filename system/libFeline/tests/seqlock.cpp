@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <feline/seqlock.h>
+#include <feline/tests.h>
+
+/* Not a multiple of a word, to check the last one is handled */
+struct Odd {
+		uint16_t a;
+		uint16_t b;
+		uint16_t c;
+};
+
+ADD_TEST(seqlock) {
+	initialize_loggers();
+	Seqlock<unsigned long long> time;
+	REQUIRE_EQ(time.read(), 0ull);
+	time.write(0x1234'5678'9abc'def0ull);
+	REQUIRE_EQ(time.read(), 0x1234'5678'9abc'def0ull);
+	time.write(time.read() + 1);
+	REQUIRE_EQ(time.read(), 0x1234'5678'9abc'def1ull);
+
+	/* Copies take a consistent snapshot */
+	Seqlock<unsigned long long> copy = time;
+	REQUIRE_EQ(copy.read(), 0x1234'5678'9abc'def1ull);
+	copy = Seqlock<unsigned long long>(5);
+	REQUIRE_EQ(copy.read(), 5ull);
+	REQUIRE_EQ(time.read(), 0x1234'5678'9abc'def1ull);
+
+	Seqlock<Odd> odd(Odd{1, 2, 3});
+	odd.write(Odd{4, 5, 6});
+	Odd value = odd.read();
+	REQUIRE_EQ(value.a, 4u);
+	REQUIRE_EQ(value.b, 5u);
+	REQUIRE_EQ(value.c, 6u);
+
+	return 0;
+}
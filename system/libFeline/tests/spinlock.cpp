@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: MIT */
+/* Copyright (c) 2024 James McNaughton Felder */
+
+#include <feline/spinlock.h>
+#include <feline/tests.h>
+
+template <typename Lock> static int test_lock() {
+	Lock lock;
+
+	/* A free lock can be taken, but not again until it is released */
+	REQUIRE(lock.try_acquire_lock());
+	REQUIRE_NOT(lock.try_acquire_lock());
+	REQUIRE_NOT(lock.try_acquire_lock());
+	lock.release_lock();
+
+	lock.acquire_lock();
+	REQUIRE_NOT(lock.try_acquire_lock());
+	lock.release_lock();
+	REQUIRE(lock.try_acquire_lock());
+	lock.release_lock();
+
+	/* Taking it many times in a row doesn't leave it in a bad state */
+	for (int i = 0; i < 100; ++i) {
+		lock.acquire_lock();
+		lock.release_lock();
+	}
+	REQUIRE(lock.try_acquire_lock());
+	lock.release_lock();
+
+	LockStats stats = lock.stats();
+#ifdef LOCK_STATS
+	/* Nobody else wanted it, so it was never contended */
+	REQUIRE_EQ(stats.acquisitions, 104u);
+	REQUIRE_EQ(stats.contended, 0u);
+	REQUIRE_EQ(stats.spins, 0u);
+#else
+	REQUIRE_EQ(stats.acquisitions, 0u);
+#endif
+	return 0;
+}
+
+ADD_TEST(spinlock) {
+	initialize_loggers();
+	if (int result = test_lock<Spinlock>()) {
+		return result;
+	}
+	if (int result = test_lock<TicketLock>()) {
+		return result;
+	}
+	return test_lock<MCSLock>();
+}
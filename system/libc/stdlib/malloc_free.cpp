@@ -10,9 +10,22 @@
 #if defined(__is_libk)
 #include <feline/spinlock.h>
 #include <kernel/mem.h>
+#ifdef HEAP_PROFILE
+#include <kernel/heap_profile.h>
+#endif /* HEAP_PROFILE */
 #endif /* __is_libk */
 
-Spinlock allocation_lock;
+KernelLock allocation_lock;
+
+/* How much checking the heap does (set by CMake):
+ * 0: none, for release builds
+ * 1: fill freed memory with FREED_POISON
+ * 2: also check freed memory is still FREED_POISON when it is handed out
+ *    again, to catch use-after-free writes */
+#ifndef HEAP_POISON_LEVEL
+#define HEAP_POISON_LEVEL 1
+#endif
+static constexpr uint8_t FREED_POISON = 0xDD;
 
 static const size_t DEFAULT_MEMRESERVE_SIZE = 4096;
 struct Header {
@@ -21,11 +34,42 @@ struct Header {
 		size_t len = DEFAULT_MEMRESERVE_SIZE;
 		bool in_use = false;
 		bool start_of_allocation;
+#if defined(__is_libk) && defined(HEAP_PROFILE)
+		/* The call site that allocated this, for heap_profile_free */
+		uint16_t profile_site;
+#else
 		uint8_t canary[2];
+#endif
 };
+/* split_header rounds allocations to a multiple of the header, so this is
+ * what malloc's results are aligned to */
+static_assert(sizeof(Header) == 16);
 
 static Header *first_header;
 
+/* Mark len bytes at addr as free memory */
+static inline void poison(void *addr [[maybe_unused]],
+                          size_t len [[maybe_unused]]) {
+#if HEAP_POISON_LEVEL >= 1
+	memset(addr, FREED_POISON, len);
+#endif
+}
+
+/* Make sure nothing wrote to hdr's memory while it was free */
+static inline void check_poison(Header *hdr [[maybe_unused]]) {
+#if HEAP_POISON_LEVEL >= 2
+	auto *data = reinterpret_cast<uint8_t *>(hdr + 1);
+	for (size_t i = 0; i < hdr->len; ++i) {
+		if (data[i] != FREED_POISON) {
+			kCriticalNoAlloc() << "Freed memory at " << ptr(&data[i])
+							   << " was written to (found " << hex(data[i])
+							   << ")! Use after free?";
+			std::abort();
+		}
+	}
+#endif
+}
+
 // Split a chunk of memory into two pieces, the first split bytes long
 // and the other containing all the remaining memory
 static void split_header(Header *&current_header, size_t split) {
@@ -61,10 +105,10 @@ static void split_header(Header *&current_header, size_t split) {
 // May add another one after to reduce the number of syscalls.
 [[nodiscard]] static Header *allocate_more_mem(size_t needed) {
 	Header *hdr;
+	size_t allocated =
+		round_to_multiple_of(needed + sizeof(Header), DEFAULT_MEMRESERVE_SIZE);
 #ifdef __is_libk
-	auto result = get_mem(
-		reinterpret_cast<void **>(&hdr),
-		round_to_multiple_of(needed + sizeof(Header), DEFAULT_MEMRESERVE_SIZE));
+	auto result = get_mem(reinterpret_cast<void **>(&hdr), allocated);
 	switch (result) {
 	case mem_success:
 		break;
@@ -92,9 +136,10 @@ static void split_header(Header *&current_header, size_t split) {
 	/* cppcheck-suppress uninitvar */
 	hdr->next = nullptr;
 	hdr->prev = nullptr;
-	hdr->len = DEFAULT_MEMRESERVE_SIZE - sizeof(Header);
+	hdr->len = allocated - sizeof(Header);
 	hdr->in_use = false;
 	hdr->start_of_allocation = true;
+	poison(hdr + 1, hdr->len);
 	if (needed < hdr->len - sizeof(Header)) {
 		split_header(hdr, needed);
 	}
@@ -128,8 +173,12 @@ void *malloc(size_t size) {
 	if (hdr->len > size + sizeof(Header)) {
 		split_header(hdr, size);
 	}
+	check_poison(hdr);
 	hdr->in_use = true;
 	assert(hdr->in_use);
+#if defined(__is_libk) && defined(HEAP_PROFILE)
+	hdr->profile_site = heap_profile_alloc(hdr->len);
+#endif
 	allocation_lock.release_lock();
 	return hdr + 1;
 }
@@ -158,16 +207,22 @@ void free(void *ptr) {
 		std::abort();
 	}
 	hdr->in_use = false;
-	memset(hdr + 1, 0xDD, hdr->len);
+#if defined(__is_libk) && defined(HEAP_PROFILE)
+	heap_profile_free(hdr->profile_site, hdr->len);
+#endif
+	poison(hdr + 1, hdr->len);
 	if (hdr->next && !hdr->next->in_use && !hdr->next->start_of_allocation &&
 	    hdr->next ==
 	        reinterpret_cast<Header *>(reinterpret_cast<uintptr_t>(hdr) +
 	                                   hdr->len + sizeof(Header))) {
-		if (hdr->next->next) {
-			hdr->next->next->prev = hdr;
+		Header *merged = hdr->next;
+		if (merged->next) {
+			merged->next->prev = hdr;
 		}
-		hdr->len += hdr->next->len + sizeof(Header);
-		hdr->next = hdr->next->next;
+		hdr->len += merged->len + sizeof(Header);
+		hdr->next = merged->next;
+		/* The merged header is free memory now */
+		poison(merged, sizeof(Header));
 	}
 	if (!hdr->start_of_allocation && hdr->prev && hdr->prev->in_use == false &&
 	    hdr ==
@@ -178,42 +233,30 @@ void free(void *ptr) {
 		if (hdr->next) {
 			hdr->next->prev = hdr->prev;
 		}
+		Header *merged = hdr;
 		hdr = hdr->prev;
+		poison(merged, sizeof(Header));
 	}
-	while (hdr->start_of_allocation &&
-	       hdr->len >= DEFAULT_MEMRESERVE_SIZE - sizeof(Header)) {
-		if (hdr->len == DEFAULT_MEMRESERVE_SIZE - sizeof(Header)) {
-			if (hdr->prev) {
-				hdr->prev->next = hdr->next;
-			}
-			if (hdr->next) {
-				hdr->next->prev = hdr->prev;
-			}
-			if (hdr == first_header) {
-				first_header = hdr->next;
-			}
-			return_mem(hdr);
-			break;
-		} else {
-			Header *to_del = hdr;
-			hdr += DEFAULT_MEMRESERVE_SIZE / sizeof(Header);
-			hdr->next = to_del->next;
-			hdr->prev = to_del->prev;
-			hdr->len = to_del->len - DEFAULT_MEMRESERVE_SIZE;
-			hdr->in_use = false;
-			hdr->start_of_allocation = true;
-			if (to_del->prev) {
-				to_del->prev->next = hdr;
-			}
-			if (to_del->next) {
-				to_del->next->prev = hdr;
-			}
-			if (to_del == first_header) {
-				first_header = hdr;
-			}
-			return_mem(to_del);
-			break;
+	/* Give a region back once all of it is free. The kernel can only free
+	 * whole regions, not pages from one. After merging, anything still in the
+	 * same region as hdr (next to it, but not the start of another region) is
+	 * in use. */
+	bool rest_in_use =
+		hdr->next && !hdr->next->start_of_allocation &&
+		hdr->next ==
+			reinterpret_cast<Header *>(reinterpret_cast<uintptr_t>(hdr) +
+		                               hdr->len + sizeof(Header));
+	if (hdr->start_of_allocation && !rest_in_use) {
+		if (hdr->prev) {
+			hdr->prev->next = hdr->next;
+		}
+		if (hdr->next) {
+			hdr->next->prev = hdr->prev;
+		}
+		if (hdr == first_header) {
+			first_header = hdr->next;
 		}
+		return_mem(hdr);
 	}
 	allocation_lock.release_lock();
 }